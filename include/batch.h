@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <sstream>
+#include <string>
+
+// What each line of a batch run gets: a fixed-depth or fixed-node search, or a perft count
+struct BatchOptions {
+    std::string input;
+    std::string output;
+    int depth = 0;
+    uint64_t nodes = 0;
+    int perft_depth = 0;
+    int threads = 1;
+    bool csv = false;        // JSONL otherwise
+    size_t window = 4096;    // Lines in flight: bounds both the job queue and the reorder buffer
+    size_t hash_mb = 0;      // Resize the shared TT first, 0 keeps it as it is
+};
+
+// Streams an EPD/FEN file (one position per line, EPD opcodes allowed after the four board
+// fields) through `threads` workers and writes one result per line in input order. Memory
+// use depends on window, not on the size of the input. Returns false if a file can't be
+// opened; bad lines are reported in the output and don't stop the run.
+bool run_batch(const BatchOptions& opts, std::string& error);
+
+// "batch <in> <out> [depth D | nodes N | perft D] [threads N] [csv|jsonl] [window N] [hash MB]", from
+// the UCI loop or the command line. Threads default to every core, the budget to depth 6.
+bool batch_command(std::istringstream& args);
@@ -0,0 +1,174 @@
+#pragma once
+#include <bit>
+#include <cstdint>
+
+// One bit per square, same a1 = bit 0 ... h8 = bit 63 layout as board[64]
+using Bitboard = uint64_t;
+
+constexpr Bitboard FILE_A_BB = 0x0101010101010101ULL;
+constexpr Bitboard FILE_H_BB = FILE_A_BB << 7;
+constexpr Bitboard RANK_1_BB = 0xFFULL;
+constexpr Bitboard RANK_2_BB = RANK_1_BB << 8;
+constexpr Bitboard RANK_3_BB = RANK_1_BB << 16;
+constexpr Bitboard RANK_4_BB = RANK_1_BB << 24;
+constexpr Bitboard RANK_5_BB = RANK_1_BB << 32;
+constexpr Bitboard RANK_6_BB = RANK_1_BB << 40;
+constexpr Bitboard RANK_7_BB = RANK_1_BB << 48;
+constexpr Bitboard RANK_8_BB = RANK_1_BB << 56;
+
+constexpr Bitboard square_bb(int s) { return 1ULL << s; }
+
+inline int popcount(Bitboard b) { return std::popcount(b); }
+inline int lsb(Bitboard b) { return std::countr_zero(b); } // b must be non-zero
+inline int pop_lsb(Bitboard& b) {
+    int s = lsb(b);
+    b &= b - 1;
+    return s;
+}
+
+// Shift the whole board one step, dropping anything that would wrap around a file edge
+constexpr Bitboard shift_north(Bitboard b) { return b << 8; }
+constexpr Bitboard shift_south(Bitboard b) { return b >> 8; }
+constexpr Bitboard shift_north_east(Bitboard b) { return (b & ~FILE_H_BB) << 9; }
+constexpr Bitboard shift_north_west(Bitboard b) { return (b & ~FILE_A_BB) << 7; }
+constexpr Bitboard shift_south_east(Bitboard b) { return (b & ~FILE_H_BB) >> 7; }
+constexpr Bitboard shift_south_west(Bitboard b) { return (b & ~FILE_A_BB) >> 9; }
+
+// Fixed tables, generated at compile time. The delta walks below only ever run in the
+// compiler; at run time every probe is a single load.
+constexpr bool on_board(int f, int r) { return f >= 0 && f < 8 && r >= 0 && r < 8; }
+
+constexpr Bitboard leaper_attacks(int s, const int (&df)[8], const int (&dr)[8]) {
+    Bitboard b = 0;
+    for (int i = 0; i < 8; i++) {
+        int f = (s & 7) + df[i], r = (s >> 3) + dr[i];
+        if (on_board(f, r)) b |= square_bb(r * 8 + f);
+    }
+    return b;
+}
+
+// Walk from s one step at a time in direction (df, dr), stopping after the first square in occ
+constexpr Bitboard ray_attacks(int s, int df, int dr, Bitboard occ) {
+    Bitboard b = 0;
+    for (int f = (s & 7) + df, r = (s >> 3) + dr; on_board(f, r); f += df, r += dr) {
+        b |= square_bb(r * 8 + f);
+        if (occ & square_bb(r * 8 + f)) break;
+    }
+    return b;
+}
+
+constexpr int KNIGHT_DF[8] = { +1, +2, +2, +1, -1, -2, -2, -1 };
+constexpr int KNIGHT_DR[8] = { +2, +1, -1, -2, -2, -1, +1, +2 };
+constexpr int KING_DF[8] = { -1,  0, +1, -1, +1, -1,  0, +1 };
+constexpr int KING_DR[8] = { -1, -1, -1,  0,  0, +1, +1, +1 };
+// First four are the rook directions, last four the bishop ones
+constexpr int RAY_DF[8] = {  0,  0, +1, -1, +1, -1, +1, -1 };
+constexpr int RAY_DR[8] = { +1, -1,  0,  0, +1, +1, -1, -1 };
+
+constexpr Bitboard slider_attacks(int s, Bitboard occ, bool diagonal) {
+    Bitboard b = 0;
+    for (int d = diagonal ? 4 : 0; d < (diagonal ? 8 : 4); d++) b |= ray_attacks(s, RAY_DF[d], RAY_DR[d], occ);
+    return b;
+}
+
+struct AttackTables {
+    Bitboard knight[64] = {};
+    Bitboard king[64] = {};
+    Bitboard pawn[2][64] = {};
+    Bitboard bishop_rays[64] = {}; // Empty board
+    Bitboard rook_rays[64] = {};
+    Bitboard between[64][64] = {};
+    Bitboard line[64][64] = {};
+};
+
+constexpr AttackTables make_attack_tables() {
+    AttackTables t;
+    for (int s = 0; s < 64; s++) {
+        t.knight[s] = leaper_attacks(s, KNIGHT_DF, KNIGHT_DR);
+        t.king[s] = leaper_attacks(s, KING_DF, KING_DR);
+        t.pawn[0][s] = shift_north_east(square_bb(s)) | shift_north_west(square_bb(s));
+        t.pawn[1][s] = shift_south_east(square_bb(s)) | shift_south_west(square_bb(s));
+        t.bishop_rays[s] = slider_attacks(s, 0, true);
+        t.rook_rays[s] = slider_attacks(s, 0, false);
+    }
+    // Follow each ray from a: every square on it is aligned with a, the squares passed on
+    // the way are the ones between, and the ray both ways through a is the line
+    for (int a = 0; a < 64; a++) {
+        for (int d = 0; d < 8; d++) {
+            Bitboard full = ray_attacks(a, RAY_DF[d], RAY_DR[d], 0) | ray_attacks(a, -RAY_DF[d], -RAY_DR[d], 0) | square_bb(a);
+            Bitboard passed = 0;
+            for (int f = (a & 7) + RAY_DF[d], r = (a >> 3) + RAY_DR[d]; on_board(f, r); f += RAY_DF[d], r += RAY_DR[d]) {
+                int b = r * 8 + f;
+                t.between[a][b] = passed;
+                t.line[a][b] = full;
+                passed |= square_bb(b);
+            }
+        }
+    }
+    return t;
+}
+
+inline constexpr AttackTables ATTACKS = make_attack_tables();
+
+// Leaper tables
+inline constexpr const Bitboard (&KNIGHT_ATTACKS)[64] = ATTACKS.knight;
+inline constexpr const Bitboard (&KING_ATTACKS)[64] = ATTACKS.king;
+inline constexpr const Bitboard (&PAWN_ATTACKS)[2][64] = ATTACKS.pawn; // [side][sq] = squares a pawn of that side on sq attacks
+
+// Bishop/rook attacks on an empty board
+inline constexpr const Bitboard (&BISHOP_RAYS)[64] = ATTACKS.bishop_rays;
+inline constexpr const Bitboard (&ROOK_RAYS)[64] = ATTACKS.rook_rays;
+
+// Squares strictly between two squares on a shared rank/file/diagonal, and the whole
+// line through them (edge to edge). Both are 0 when the squares aren't aligned.
+inline constexpr const Bitboard (&BETWEEN)[64][64] = ATTACKS.between;
+inline constexpr const Bitboard (&LINE)[64][64] = ATTACKS.line;
+
+static_assert(KNIGHT_ATTACKS[0] == 0x20400ULL && KING_ATTACKS[63] == 0x40C0000000000000ULL);
+static_assert(BETWEEN[0][63] == 0x0040201008040200ULL && LINE[0][7] == RANK_1_BB && BETWEEN[0][10] == 0);
+
+// Slider lookup entry. Both indexing schemes share the same attack table layout:
+// magic: ((occ & mask) * magic) >> shift, PEXT: pext(occ, mask)
+struct Magic {
+    Bitboard mask = 0;
+    Bitboard magic = 0;
+    Bitboard* attacks = nullptr;
+    unsigned shift = 0;
+};
+
+extern Magic BISHOP_MAGICS[64];
+extern Magic ROOK_MAGICS[64];
+extern bool use_pext; // Picked once at startup by init_bitboards()
+
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define CHESSBOT_HAS_PEXT 1
+// Inline asm so this compiles without -mbmi2; only executed when the CPU reported BMI2
+inline uint64_t pext(uint64_t src, uint64_t mask) {
+    uint64_t r;
+    __asm__("pextq %2, %1, %0" : "=r"(r) : "r"(src), "r"(mask));
+    return r;
+}
+#else
+#define CHESSBOT_HAS_PEXT 0
+#endif
+
+inline unsigned magic_index(const Magic& m, Bitboard occ) {
+#if CHESSBOT_HAS_PEXT
+    if (use_pext) return (unsigned)pext(occ, m.mask);
+#endif
+    return (unsigned)(((occ & m.mask) * m.magic) >> m.shift);
+}
+
+inline Bitboard bishop_attacks(int s, Bitboard occ) {
+    const Magic& m = BISHOP_MAGICS[s];
+    return m.attacks[magic_index(m, occ)];
+}
+inline Bitboard rook_attacks(int s, Bitboard occ) {
+    const Magic& m = ROOK_MAGICS[s];
+    return m.attacks[magic_index(m, occ)];
+}
+inline Bitboard queen_attacks(int s, Bitboard occ) {
+    return bishop_attacks(s, occ) | rook_attacks(s, occ);
+}
+
+void init_bitboards();
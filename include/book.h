@@ -0,0 +1,45 @@
+#pragma once
+#include "position.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Polyglot opening book (.bin): 16-byte big-endian entries { key, move, weight, learn },
+// sorted by key. The file is memory-mapped read-only and searched in place, so nothing
+// is copied to the heap and every engine process on the machine shares the same pages.
+class PolyglotBook {
+public:
+    PolyglotBook() = default;
+    PolyglotBook(const PolyglotBook&) = delete;
+    PolyglotBook& operator=(const PolyglotBook&) = delete;
+    ~PolyglotBook() { close(); }
+
+    bool open(const std::string& path, std::string& error);
+    void close();
+    bool loaded() const { return data != nullptr; }
+    size_t size() const { return count; }
+
+    // A legal book move for pos: the heaviest one when best is set, otherwise picked at
+    // random in proportion to the weights. Returns false when pos isn't in the book.
+    bool probe(const Position& pos, bool best, Move& out) const;
+
+private:
+    const unsigned char* data = nullptr;
+    size_t count = 0;
+    size_t mapped_bytes = 0;
+#ifdef _WIN32
+    void* file_handle = nullptr;
+    void* mapping_handle = nullptr;
+#endif
+};
+
+// Position key in the Polyglot scheme (see book.cpp for the random table)
+uint64_t polyglot_key(const Position& pos);
+// Keys of the published Polyglot test positions that come out wrong (0 when all match)
+int verify_polyglot_keys();
+
+// Debug/tooling: reads the games of a PGN file (SAN movetext from the initial position);
+// every position in the first maxPly plies gets an entry (weight = times seen, capped).
+// Writes a sorted Polyglot file.
+bool make_book(const std::string& pgnPath, const std::string& outPath, int maxPly, std::string& error);
@@ -2,38 +2,71 @@
 #include <string>
 #include <cstdint>
 
+// Side in bit 3, type in bits 0-2: a piece is one byte and either half is a mask away.
+// Codes 7 and 8 are unused.
 enum Piece {
     EMPTY = 0,
-    WP, WN, WB, WR, WQ, WK,
-    BP, BN, BB, BR, BQ, BK
+    WP = 1, WN, WB, WR, WQ, WK,
+    BP = 9, BN, BB, BR, BQ, BK
 };
+constexpr int PIECE_NB = 16; // Size of anything indexed by Piece
 enum Side  : int { WHITE = 0, BLACK = 1 };
+enum PieceType { NO_TYPE = 0, PAWN, KNIGHT, BISHOP, ROOK, QUEEN, KING };
 
-extern int board[64];
-extern int side_to_move;
+// Piece enum <-> (side, type). Only valid for non-empty pieces.
+constexpr int make_piece(int side, int type) { return (side << 3) | type; }
+constexpr int piece_side(int p) { return p >> 3; }
+constexpr int piece_type(int p) { return p & 7; }
 
+// Search depth limit (plies from the root), also sizes the per-ply tables and undo headroom
+constexpr int MAX_PLY = 128;
+// Longest game the undo stack keeps whole; past that the oldest moves are forgotten
+constexpr int MAX_GAME_PLY = 2048;
+
+// What kind of move it is, so make_move never has to work that out from the board
+enum MoveFlag : int {
+    MOVE_NORMAL = 0,
+    MOVE_CASTLE = 1, // King's from/to; the rook hop is implied
+    MOVE_EP = 2,
+    MOVE_PROMO = 4,  // + 0..3 for knight, bishop, rook, queen
+};
+
+// Packed into 16 bits: from (6) | to (6) | flag (4). All zeros (a1a1) means no move.
 struct Move {
-    uint8_t from = 0;
-    uint8_t to = 0;
-    uint8_t promo = 0; // 0 = none, otherwise piece enum (WQ/WR/WB/WN or BQ/...)
+    uint16_t data = 0;
+
+    Move() = default;
+    constexpr Move(int from, int to, int flag = MOVE_NORMAL)
+        : data((uint16_t)(from | (to << 6) | (flag << 12))) {}
+    static constexpr Move promotion(int from, int to, int type) {
+        return Move(from, to, MOVE_PROMO + type - KNIGHT);
+    }
+
+    constexpr int from() const { return data & 63; }
+    constexpr int to() const { return (data >> 6) & 63; }
+    constexpr int flag() const { return data >> 12; }
+    constexpr bool is_none() const { return from() == to(); }
+    constexpr bool is_castle() const { return flag() == MOVE_CASTLE; }
+    constexpr bool is_ep() const { return flag() == MOVE_EP; }
+    constexpr bool is_promo() const { return flag() >= MOVE_PROMO; }
+    constexpr int promo_type() const { return is_promo() ? flag() - MOVE_PROMO + KNIGHT : NO_TYPE; }
+
+    bool operator==(const Move&) const = default;
 };
 
+// Whatever the board can't tell us on the way back. Left uninitialized on purpose:
+// make_move fills every field, and the undo stack is a big fixed array.
 struct Undo {
-    uint8_t from = 0;
-    uint8_t to = 0;
-    int moved = EMPTY;
-    int captured = EMPTY;
-    uint8_t promo = 0; // Same encoding as Move
-    int prev_side = WHITE;
-    int prev_castling = 0; // Added to undo castling
-    int prev_ep = -1;
-    bool was_ep = false; // True when prev. is en passant
+    uint64_t prev_key; // Zobrist key before the move, restored as-is on undo
+    Move move;
+    uint8_t moved;
+    uint8_t captured; // EMPTY for ep (the victim is always a pawn behind move.to())
+    uint8_t prev_castling;
+    int8_t prev_ep;
 };
 
-// Lifecycle
+// Lifecycle (global tables only, positions live in Position)
 void init();
-void set_startpos();
-bool set_fen(const char* fen);
 
 // UCI
 void uci_loop();
@@ -42,9 +75,9 @@ void uci_loop();
 int sq(int file, int rank); // File a-h, rank 1-8
 
 // Move parsing
-bool parse_uci_move(const std::string& s, Move& out);
 int parse_square(char fileChar, char rankChar); // Returns 0..63 or -1
 int promo_char_to_piece(char c, int side); // Returns piece enum or 0 if none/invalid
+std::string move_to_uci(const Move& m); // Ex. e2e4, e7e8q
 
 // Move list
 struct MoveList {
@@ -58,14 +91,5 @@ struct LegalMoveList {
     int count = 0;
 };
 
-void gen_moves(MoveList& list);
-void gen_legal_moves(MoveList& legal);
-
-// Make/undo stack (search foundation)
-void clear_history();
-bool make_move_basic(const Move &m); // Will remove later
-bool make_move(const Move& m);
-bool undo_move();
-
 // Debug
 char piece_to_char(int p);
\ No newline at end of file
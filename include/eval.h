@@ -0,0 +1,20 @@
+#pragma once
+#include "position.h"
+
+// Material + piece-square values per (piece, square), white-positive, for both game
+// phases. Position keeps running sums of these, so evaluate() never scans the board.
+extern int PSQ_MG[PIECE_NB][64];
+extern int PSQ_EG[PIECE_NB][64];
+extern const int PHASE_WEIGHT[PIECE_NB]; // Knight/bishop 1, rook 2, queen 4
+constexpr int MAX_PHASE = 24;      // Opening material; more (after promotions) is clamped
+
+void init_eval();
+
+class PawnTable;
+
+// Centipawns from the side to move's point of view. Searchers pass their own pawn table;
+// without one the pawn structure is worked out from scratch.
+int evaluate(const Position& pos, PawnTable* pawns = nullptr);
+
+// Full from-scratch breakdown for the "eval" command, also checks the running sums
+void eval_trace(const Position& pos);
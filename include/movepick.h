@@ -0,0 +1,40 @@
+#pragma once
+#include "position.h"
+
+// Butterfly history, [side][from][to]: how well a quiet move has done as a cutoff move,
+// kept within +-HISTORY_MAX by update_history so old results fade
+constexpr int HISTORY_MAX = 16384;
+using ButterflyHistory = int[2][64][64];
+void update_history(int& entry, int bonus);
+
+// Hands out the moves of a node best-first, generating each stage only once the earlier
+// ones are used up, so a cutoff on the hash move costs no generation at all:
+//   hash move (checked with is_pseudo_legal/is_legal), tactical moves by MVV-LVA that don't
+//   lose material by SEE, the two killers, quiets by history, then the losing tacticals.
+// Every move returned is legal and comes out exactly once.
+class MovePicker {
+public:
+    MovePicker(Position& pos, const Move& hashMove, const Move* killers, const ButterflyHistory& history);
+    // Quiescence: winning and even tactical moves only, nothing else
+    explicit MovePicker(Position& pos);
+    bool next(Move& out); // False when there is nothing left
+
+private:
+    enum Stage { HASH, TACTICAL_INIT, TACTICAL, KILLER1, KILLER2, QUIET_INIT, QUIETS, BAD_TACTICAL,
+                 QS_TACTICAL_INIT, QS_TACTICAL, DONE };
+
+    bool usable_killer(const Move& m) const;
+    void score_tactical();
+    bool pick_best(Move& out); // One selection sort step over list/scores
+    bool pick_good_tactical(Move& out); // Same, setting SEE losers aside into bad
+
+    Position& pos;
+    Move hash_move;
+    Move killers[2];
+    const ButterflyHistory* history = nullptr;
+    int stage = HASH;
+    MoveList list;
+    MoveList bad;
+    int scores[256];
+    int cur = 0;
+};
@@ -0,0 +1,53 @@
+#pragma once
+#include "defs.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Position;
+
+// HalfKP-style network: for each perspective, the inputs are (own king square, piece, square)
+// for every non-king piece, 64 * 10 * 64 = 40960 features, into NNUE_HIDDEN int16 neurons.
+// Both halves are clipped to [0, 127] and fed to a single linear output.
+constexpr int NNUE_INPUTS = 64 * 10 * 64;
+constexpr int NNUE_HIDDEN = 256;
+
+// First-layer sums for both perspectives ([side] = seen from that side's king)
+struct alignas(64) Accumulator {
+    int16_t v[2][NNUE_HIDDEN];
+};
+
+// One accumulator per ply of the current line. A searcher owns one and attaches it to its
+// Position; make_move then pushes an accumulator updated from its parent by adding and
+// subtracting the weight columns of the pieces that changed, and undo_move pops it again.
+class NnueStack {
+public:
+    NnueStack();
+    void reset(const Position& pos); // Full refresh for the root
+    void push(const Position& pos, const Undo& u);
+    void pop() { if (top > 0) top--; }
+    const Accumulator& current() const { return stack[top]; }
+
+private:
+    std::vector<Accumulator> stack;
+    int top = 0;
+};
+
+// Network file layout (little endian): "CBNN", u32 version (1), u32 inputs, u32 hidden,
+// i16 ft_bias[hidden], i16 ft_weights[inputs][hidden], i16 out_weights[2 * hidden],
+// i32 out_bias, i32 out_scale. Returns false (and keeps any previous net) on a bad file.
+bool nnue_load(const std::string& path, std::string& error);
+void nnue_unload(); // Back to the classical eval
+bool nnue_loaded();
+const char* nnue_kernel_name(); // "avx2", "sse2" or "scalar", picked at startup
+
+void init_nnue();
+
+// Centipawns for the side to move from an up-to-date accumulator
+int nnue_evaluate(const Position& pos, const Accumulator& acc);
+// Same, refreshing from scratch (debug cross-check for the incremental path)
+int nnue_evaluate_full(const Position& pos);
+// Debug: compares the incremental accumulators against a full refresh at every node of
+// a depth-limited walk from root. Returns the number of nodes that differ.
+uint64_t verify_nnue(const Position& root, int depth);
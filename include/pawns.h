@@ -0,0 +1,41 @@
+#pragma once
+#include "position.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Pawn structure terms for one set of pawns, white-positive like the PSQ sums
+struct PawnEntry {
+    uint64_t key = 0;
+    Bitboard passed = 0; // Passed pawns of both sides, for the per-node passer terms
+    int16_t mg = 0;      // Doubled, isolated, backward and passed pawns
+    int16_t eg = 0;
+    // The shelter in front of a king depends on where it stands, so it is kept for the
+    // square it was last worked out for and redone only when the king has moved
+    uint8_t king_sq[2] = { 64, 64 };
+    int16_t shelter[2] = { 0, 0 }; // Middlegame, good for that side
+};
+
+constexpr size_t PAWN_TABLE_ENTRIES = 16384; // 512 KB
+
+// Cache of PawnEntry by Position::pawn_key(). Not shared: every search thread owns one,
+// so there is no locking.
+class PawnTable {
+public:
+    PawnTable();
+    PawnEntry& probe(const Position& pos); // Evaluates into the slot first on a miss
+    void clear();
+
+private:
+    std::unique_ptr<PawnEntry[]> entries;
+};
+
+void init_pawns();
+
+// From scratch into e (the table calls this on a miss, the eval trace calls it directly)
+void evaluate_pawns(const Position& pos, PawnEntry& e);
+// White-positive endgame bonus for e's passed pawns that have a free square in front
+int free_passers(const Position& pos, const PawnEntry& e);
+// Shelter for side's king, from e's cache when the king hasn't moved since
+int king_shelter(const Position& pos, PawnEntry& e, int side);
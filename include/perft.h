@@ -0,0 +1,63 @@
+#pragma once
+#include "position.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Hit/probe counts for one perft run (kept by the caller, not in the shared table)
+struct PerftStats {
+    uint64_t probes = 0;
+    uint64_t hits = 0;
+};
+
+// Fixed-size cache of subtree node counts, keyed on position key + remaining depth.
+// Entries are stored as (key ^ data, data) so a torn write from another thread just
+// fails verification instead of returning a wrong count, which keeps the table lock-free.
+class PerftTable {
+public:
+    void resize(size_t mb);
+    void clear();
+    size_t size_mb() const { return buckets * sizeof(Bucket) >> 20; }
+
+    bool probe(uint64_t key, int depth, uint64_t& nodes) const;
+    void store(uint64_t key, int depth, uint64_t nodes);
+
+private:
+    struct Entry {
+        std::atomic<uint64_t> check{0}; // key ^ data
+        std::atomic<uint64_t> data{0};  // nodes << 8 | depth, depth 0 marks an empty slot
+    };
+    struct alignas(64) Bucket {
+        Entry e[4];
+    };
+
+    std::unique_ptr<Bucket[]> table;
+    size_t buckets = 0;
+};
+
+// How a perft run should be done, shared by the perft and perftsuite commands
+struct PerftOptions {
+    int threads = 1;
+    bool hashed = false;
+    size_t hash_mb = 16;
+};
+
+uint64_t perft(Position& pos, int depth);
+uint64_t perft_hashed(Position& pos, int depth, PerftTable& tt, PerftStats& stats);
+// Work-stealing perft over `threads` workers, each with its own copy of root. tt may be null.
+uint64_t perft_parallel(const Position& root, int depth, int threads, PerftTable* tt, PerftStats& stats);
+// Picks the plain, hashed or parallel counter from opts (tt is resized by the caller)
+uint64_t run_perft(Position& pos, int depth, const PerftOptions& opts, PerftTable& tt, PerftStats& stats);
+void perft_divide(Position& pos, int depth);
+// Runs the embedded reference positions, prints one line each; returns true if all match
+bool perft_suite(const PerftOptions& opts, PerftTable& tt);
+uint64_t verify_keys(Position& pos, int depth);
+uint64_t verify_legal(Position& pos, int depth);
+// Randomized cross-check of is_pseudo_legal/is_legal against gen_legal_moves
+uint64_t verify_move_checks(int games, uint64_t seed);
+// Malformed FENs must be rejected (or their ep square dropped); returns how many weren't
+uint64_t verify_fen_checks();
+// is_square_attacked against a mailbox walk: ns per call for each, and any disagreement
+void attack_bench(int rounds);
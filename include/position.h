@@ -0,0 +1,159 @@
+#pragma once
+#include "defs.h"
+#include "bitboard.h"
+#include "nnue.h"
+
+#include <algorithm>
+
+// Evaluation tables the piece helpers update from (defined in eval.cpp)
+extern int PSQ_MG[PIECE_NB][64];
+extern int PSQ_EG[PIECE_NB][64];
+extern const int PHASE_WEIGHT[PIECE_NB];
+
+// Zobrist keys, filled by init(). Castling is indexed by the whole KQkq mask, ep by file.
+extern uint64_t ZOBRIST_PIECE[PIECE_NB][64];
+extern uint64_t ZOBRIST_CASTLING[16];
+extern uint64_t ZOBRIST_EP[8];
+extern uint64_t ZOBRIST_SIDE;
+
+// Undo records for the game so far plus the line being searched, in a fixed array so
+// make_move never allocates. Copies only take the entries in use.
+class UndoStack {
+public:
+    UndoStack() = default;
+    UndoStack(const UndoStack& o) : count(o.count) { std::copy(o.items, o.items + o.count, items); }
+    UndoStack& operator=(const UndoStack& o) {
+        count = o.count;
+        std::copy(o.items, o.items + o.count, items);
+        return *this;
+    }
+
+    int size() const { return count; }
+    bool empty() const { return count == 0; }
+    void clear() { count = 0; }
+    const Undo& operator[](int i) const { return items[i]; }
+    const Undo& back() const { return items[count - 1]; }
+    void pop_back() { count--; }
+    void push_back(const Undo& u) {
+        // Only a game past MAX_GAME_PLY gets here: forget its oldest moves, which are far
+        // beyond anything a repetition check would still reach
+        if (count == CAPACITY) {
+            std::copy(items + MAX_PLY, items + count, items);
+            count -= MAX_PLY;
+        }
+        items[count++] = u;
+    }
+
+private:
+    static constexpr int CAPACITY = MAX_GAME_PLY + MAX_PLY;
+    Undo items[CAPACITY];
+    int count = 0;
+};
+
+// Which legal moves to generate. The move picker and quiescence search ask for the tactical
+// ones (captures, ep and every promotion) separately from the quiet rest.
+enum GenType { GEN_ALL, GEN_TACTICAL, GEN_QUIETS };
+
+// Everything that describes one game state. Nothing in here is shared, so any number of
+// positions can be searched side by side (one per thread), and copying a Position gives
+// an independent board with its own undo history.
+class Position {
+public:
+    Position();
+
+    // Lifecycle
+    bool set_fen(const char* fen);
+    // set_fen only checks the syntax. This is the rest: one king each (search, eval and
+    // NNUE all index by king square) and the side not to move isn't in check.
+    bool is_sane() const;
+    void set_startpos();
+    void clear_history();
+
+    // Movegen
+    void gen_moves(MoveList& list) const;
+    void gen_legal_moves(MoveList& legal, GenType type = GEN_ALL);
+    void gen_legal_moves_filtered(MoveList& legal); // Slow make/unmake reference, debug only
+
+    // Make/undo stack (search foundation)
+    bool make_move(const Move& m);
+    bool undo_move();
+
+    // Queries
+    int piece_on(int s) const { return board[s]; }
+    int side_to_move() const { return stm; }
+    int castling() const { return castling_rights; }
+    int ep() const { return ep_square; }
+    int king_square(int side) const { return king_sq[side]; }
+    int game_ply() const { return history.size(); }
+    uint64_t key() const { return hash_key; }
+    uint64_t compute_key() const; // From scratch, for set_fen and debug checks
+    // Pawns only, for the pawn structure cache; the piece helpers keep it current both ways
+    uint64_t pawn_key() const { return pawn_hash; }
+    uint64_t compute_pawn_key() const;
+    bool is_repetition() const;
+    // Accumulators to keep in step with make/undo (nullptr = classical eval only)
+    void attach_nnue(NnueStack* s) { nnue = s; }
+    NnueStack* nnue_stack() const { return nnue; }
+    // Running material + piece-square sums (white-positive) and game phase, see eval.h
+    int psq_mg() const { return mg_sum; }
+    int psq_eg() const { return eg_sum; }
+    int phase() const { return game_phase; }
+    Bitboard pieces(int side, int type) const { return piece_bb[make_piece(side, type)]; }
+    Bitboard pieces(int side) const { return side_bb[side]; }
+    Bitboard occupied() const { return side_bb[WHITE] | side_bb[BLACK]; }
+
+    // Single-move checks, no generation: is_legal expects a move that passed is_pseudo_legal
+    bool is_pseudo_legal(const Move& m) const;
+    bool is_legal(const Move& m) const;
+    bool is_capture(const Move& m) const; // Including ep
+    int see(const Move& m) const; // Centipawns m wins once the exchange on m.to plays out
+
+    bool is_square_attacked(int targetSq, int bySide) const;
+    bool is_in_check(int side) const;
+    Bitboard attackers_to(int s, Bitboard occ) const;
+    Bitboard pinned_pieces(int side) const;
+
+private:
+    // Every board write goes through these three so the mailbox and bitboards never disagree
+    void put_piece(int p, int s);
+    void remove_piece(int s);
+    void move_piece(int from, int to);
+
+    bool ep_capturable() const;
+    bool ep_is_legal(int from) const;
+
+    void gen_pawn_moves(MoveList& list, int side, Bitboard target, Bitboard pinned) const;
+    void gen_ep_captures(MoveList& list, int side, bool legal) const;
+    void gen_piece_moves(MoveList& list, int side, Bitboard target, Bitboard pinned) const;
+    void gen_king_moves(MoveList& list, int side, Bitboard target, bool legal) const;
+    void gen_castling(MoveList& list, int side) const;
+
+    // It should be noted to avoid any confusion that this is flipped from the display.
+    // White appears on the bottom when asking for a board display (cmd d), but white is at the top of this array.
+    // One byte per square (Piece codes), so the whole mailbox is a single cache line
+    alignas(64) uint8_t board[64];
+    // Per-piece (indexed by Piece enum) and per-side occupancy, kept in sync with board[].
+    // These double as the piece lists: generation pops bits, it never scans the board.
+    Bitboard piece_bb[PIECE_NB];
+    Bitboard side_bb[2];
+    int king_sq[2] = { -1, -1 }; // -1 when that side has no king (only in broken FENs)
+    int stm = WHITE;
+
+    // Bitmask: KQkq (white kingside, queenside, then black kingside, queenside)
+    int castling_rights = 0;
+    // En passant tracker
+    int ep_square = -1;
+    // Maintained incrementally by make_move, restored from Undo by undo_move
+    uint64_t hash_key = 0;
+    uint64_t pawn_hash = 0;
+    // Kept current by the piece helpers in both directions, so undo needs nothing saved
+    int mg_sum = 0;
+    int eg_sum = 0;
+    int game_phase = 0;
+    UndoStack history;
+    // Not owned; copies share it, so a copy that will be searched must attach its own
+    NnueStack* nnue = nullptr;
+};
+
+// Move parsing (promotion letters depend on the side to move)
+bool parse_uci_move(const Position& pos, const std::string& s, Move& out);
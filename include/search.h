@@ -0,0 +1,49 @@
+#pragma once
+#include "position.h"
+
+#include <atomic>
+#include <cstdint>
+
+constexpr int INF_SCORE = 32001;
+constexpr int MATE_SCORE = 32000;
+constexpr int MATE_BOUND = MATE_SCORE - MAX_PLY; // Scores beyond this are mate in N
+
+// Everything "go" can say. Times are in milliseconds, indexed by side.
+struct SearchLimits {
+    int depth = 0;
+    int64_t movetime = 0;
+    uint64_t nodes = 0;
+    int64_t time[2] = { 0, 0 };
+    int64_t inc[2] = { 0, 0 };
+    int movestogo = 0;
+    bool infinite = false;
+    bool ponder = false; // No limits apply until Signals.ponderhit, and the clock starts there
+    bool silent = false; // No info lines (benchmarks)
+    bool age_tt = true;  // Off when several searches run at once and the caller ages the TT
+};
+
+// Set by the UCI reader thread while a search or perft runs on the worker thread. The reader
+// clears them before starting each job, so a "stop" that comes in early is never lost.
+struct SearchSignals {
+    std::atomic<bool> stop{false};      // Finish now (search reports its best move so far)
+    std::atomic<bool> ponderhit{false}; // The pondered move was played
+};
+
+extern SearchSignals Signals;
+
+// From the last completed iteration
+struct SearchResult {
+    Move best;
+    int score = 0;
+    int depth = 0;
+    uint64_t nodes = 0;
+};
+
+// Iterative deepening alpha-beta from pos, printing UCI info lines as it goes. With infinite
+// or ponder set it doesn't return before Signals.stop (or the ponderhit), even when done. With
+// threads > 1 that many searchers share the TT (Lazy SMP) and the deepest result wins.
+// pos is left as it was passed in.
+SearchResult search(Position& pos, const SearchLimits& limits, int threads);
+
+// Time-to-depth over a fixed set of positions at 1, 2, 4 ... maxThreads threads
+void smp_bench(int depth, int maxThreads, size_t hashMb);
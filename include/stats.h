@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Search instrumentation. Built only with -DCHESSBOT_STATS=ON (CMake option); otherwise
+// every STATS_* macro below is empty and nothing here is compiled into the hot paths.
+#ifndef CHESSBOT_STATS
+#define CHESSBOT_STATS 0
+#endif
+
+// Beta cutoffs by the index of the move that caused them: 1, 2, 3, 4, 5-8, 9-16, 17+
+constexpr int CUTOFF_BUCKETS = 7;
+
+// Per-thread counters. Only the owning thread writes (plain load + store, no lock
+// prefix), the atomics are there so the stats command can read them mid-search.
+struct StatCounter {
+    std::atomic<uint64_t> v{0};
+    void add(uint64_t n) { v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+    uint64_t get() const { return v.load(std::memory_order_relaxed); }
+};
+
+struct ThreadStats {
+    StatCounter nodes, qnodes;
+    StatCounter tt_probes, tt_hits;
+    StatCounter pawn_probes, pawn_hits;
+    StatCounter cutoffs[CUTOFF_BUCKETS];
+    StatCounter movegen_calls, makes, undos;
+    StatCounter movegen_ns, eval_ns, search_ns;
+    // search_ns is added in slices while the search runs, each from here to now
+    std::chrono::steady_clock::time_point search_mark;
+
+    void search_begin() { search_mark = std::chrono::steady_clock::now(); }
+    void search_flush() {
+        auto now = std::chrono::steady_clock::now();
+        search_ns.add((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(now - search_mark).count());
+        search_mark = now;
+    }
+};
+
+// Sum over every thread that ever ran, live or finished
+struct StatsTotals {
+    uint64_t nodes = 0, qnodes = 0;
+    uint64_t tt_probes = 0, tt_hits = 0;
+    uint64_t pawn_probes = 0, pawn_hits = 0;
+    uint64_t cutoffs[CUTOFF_BUCKETS] = {};
+    uint64_t movegen_calls = 0, makes = 0, undos = 0;
+    uint64_t movegen_ns = 0, eval_ns = 0, search_ns = 0;
+};
+
+ThreadStats& thread_stats(); // This thread's block, registered on first use
+StatsTotals stats_snapshot();
+void stats_reset();          // Meant for between searches; racing increments may survive it
+// The "info string stats ..." lines (or a note that stats aren't built in)
+std::string stats_report();
+
+inline int cutoff_bucket(int moveIndex) {
+    return moveIndex <= 4 ? moveIndex - 1 : moveIndex <= 8 ? 4 : moveIndex <= 16 ? 5 : 6;
+}
+
+struct StatTimer {
+    StatCounter& into;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    explicit StatTimer(StatCounter& c) : into(c) {}
+    ~StatTimer() {
+        into.add((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    }
+};
+
+#define STATS_CONCAT2(a, b) a##b
+#define STATS_CONCAT(a, b) STATS_CONCAT2(a, b)
+
+#if CHESSBOT_STATS
+#define STATS_INC(field) thread_stats().field.add(1)
+#define STATS_CUTOFF(moveIndex) thread_stats().cutoffs[cutoff_bucket(moveIndex)].add(1)
+#define STATS_TIME(field) StatTimer STATS_CONCAT(stat_timer_, __LINE__)(thread_stats().field)
+#define STATS_SEARCH_BEGIN() thread_stats().search_begin()
+#define STATS_SEARCH_FLUSH() thread_stats().search_flush()
+#else
+#define STATS_INC(field) ((void)0)
+#define STATS_CUTOFF(moveIndex) ((void)0)
+#define STATS_TIME(field) ((void)0)
+#define STATS_SEARCH_BEGIN() ((void)0)
+#define STATS_SEARCH_FLUSH() ((void)0)
+#endif
@@ -0,0 +1,51 @@
+#pragma once
+#include "defs.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+enum Bound : int { BOUND_NONE = 0, BOUND_UPPER = 1, BOUND_LOWER = 2, BOUND_EXACT = 3 };
+
+// What a probe hands back (score is still in "from this node" form, see score_from_tt)
+struct TTData {
+    Move move;
+    int score = 0;
+    int depth = 0;
+    int bound = BOUND_NONE;
+};
+
+// Search transposition table shared by every search thread. Each entry is two 64-bit words,
+// (key ^ data, data): a reader that sees halves from two different writers gets a key that
+// doesn't verify and treats it as a miss, so no locks are needed. Four entries make a
+// 64-byte bucket, so a probe touches one cache line.
+class TranspositionTable {
+public:
+    void resize(size_t mb, int threads);
+    void clear(int threads); // Splits the wipe over `threads` threads, big tables take a while
+    void new_search();       // Bump the age so last move's entries are replaced first
+
+    bool probe(uint64_t key, TTData& out) const;
+    void store(uint64_t key, int depth, int bound, int score, const Move& m);
+    int hashfull() const;    // Permille of sampled entries written by the current search
+
+private:
+    struct Entry {
+        uint64_t check; // key ^ data
+        uint64_t data;  // move:16 | score:16 | depth:8 | bound:2 | age:6
+    };
+    struct alignas(64) Bucket {
+        Entry e[4];
+    };
+
+    std::unique_ptr<Bucket[]> table;
+    size_t buckets = 0;
+    uint8_t age = 0;
+};
+
+extern TranspositionTable TT;
+
+// Mate scores are stored relative to the node, not the root, so they stay right when the
+// same position turns up at a different ply
+int score_to_tt(int score, int ply);
+int score_from_tt(int score, int ply);
@@ -0,0 +1,287 @@
+#include "batch.h"
+#include "perft.h"
+#include "position.h"
+#include "search.h"
+#include "tt.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+struct BatchJob {
+    uint64_t index = 0; // Position in the input, decides the output order
+    uint64_t line_no = 0;
+    std::string text;
+};
+
+// Reader -> workers -> writer. Workers only take a job once its slot in the reorder ring is
+// free (index < next_write + window), so the ring never overflows and a slow line holds up
+// at most `window` finished ones behind it.
+struct BatchPipeline {
+    std::mutex mtx;
+    std::condition_variable jobs_cv;   // Workers wait for work (or for the writer to catch up)
+    std::condition_variable space_cv;  // Reader waits for room in the queue
+    std::condition_variable done_cv;   // Writer waits for the next line in order
+    std::deque<BatchJob> jobs;
+    std::vector<std::string> ring;     // Finished lines by index % window
+    std::vector<bool> ready;
+    uint64_t next_write = 0;
+    uint64_t total = 0;                // Jobs queued so far, final once eof is set
+    bool eof = false;
+};
+
+static std::string json_escape(const std::string& s) {
+    std::string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\') out += '\\';
+        if ((unsigned char)c < 0x20) continue; // Control characters have no business in an EPD
+        out += c;
+    }
+    return out;
+}
+
+static std::string csv_quote(const std::string& s) {
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"') out += '"';
+        out += c;
+    }
+    return out + "\"";
+}
+
+// First four fields are the board; FEN counters or EPD opcodes may follow. Only the "id"
+// opcode is kept, so results can be matched to a test suite's names.
+static void split_epd(const std::string& line, std::string& fen, std::string& id) {
+    std::istringstream iss(line);
+    std::string tok;
+    for (int i = 0; i < 4 && iss >> tok; i++) fen += (i ? " " : "") + tok;
+    std::string rest;
+    std::getline(iss, rest);
+    size_t p = rest.find("id ");
+    if (p != std::string::npos && (p == 0 || rest[p - 1] == ' ' || rest[p - 1] == ';')) {
+        size_t end = rest.find(';', p);
+        id = rest.substr(p + 3, end == std::string::npos ? std::string::npos : end - p - 3);
+        if (id.size() >= 2 && id.front() == '"' && id.back() == '"') id = id.substr(1, id.size() - 2);
+    }
+}
+
+static std::string analyse(const BatchJob& job, const BatchOptions& opts) {
+    std::string fen, id;
+    split_epd(job.text, fen, id);
+
+    Position pos;
+    bool ok = pos.set_fen(fen.c_str()) && pos.is_sane();
+
+    std::ostringstream out;
+    if (opts.csv) out << job.line_no << ',' << csv_quote(fen) << ',' << csv_quote(id) << ',';
+    else {
+        out << "{\"line\":" << job.line_no << ",\"fen\":\"" << json_escape(fen) << "\"";
+        if (!id.empty()) out << ",\"id\":\"" << json_escape(id) << "\"";
+    }
+
+    auto fail = [&](const char* why) {
+        if (opts.csv) out << (opts.perft_depth ? ",," : ",,,,,,") << why;
+        else out << ",\"error\":\"" << why << "\"}";
+        return out.str();
+    };
+    if (!ok) return fail("invalid position");
+
+    if (opts.perft_depth) {
+        uint64_t n = perft(pos, opts.perft_depth);
+        if (Signals.stop.load(std::memory_order_relaxed)) return fail("stopped"); // Count is short
+        if (opts.csv) out << opts.perft_depth << ',' << n << ',';
+        else out << ",\"perft_depth\":" << opts.perft_depth << ",\"nodes\":" << n << '}';
+        return out.str();
+    }
+
+    SearchLimits limits;
+    limits.depth = opts.depth;
+    limits.nodes = opts.nodes;
+    limits.silent = true;
+    limits.age_tt = false; // Aged once for the whole run, see run_batch
+    SearchResult r = search(pos, limits, 1);
+    if (Signals.stop.load(std::memory_order_relaxed)) return fail("stopped"); // Short of the budget
+
+    // No legal move: the game is over, say how instead of inventing a move and a score
+    if (r.best.is_none()) {
+        const char* result = r.score < 0 ? "checkmate" : "stalemate";
+        if (opts.csv) out << ",,,,," << result << ',';
+        else out << ",\"result\":\"" << result << "\"}";
+        return out.str();
+    }
+
+    bool mate = std::abs(r.score) >= MATE_BOUND;
+    int mateIn = r.score > 0 ? (MATE_SCORE - r.score + 1) / 2 : -(MATE_SCORE + r.score) / 2;
+    if (opts.csv) {
+        out << move_to_uci(r.best) << ',';
+        if (mate) out << ',' << mateIn;
+        else out << r.score << ',';
+        out << ',' << r.depth << ',' << r.nodes << ",,";
+    } else {
+        out << ",\"bestmove\":\"" << move_to_uci(r.best) << "\",";
+        if (mate) out << "\"mate\":" << mateIn;
+        else out << "\"cp\":" << r.score;
+        out << ",\"depth\":" << r.depth << ",\"nodes\":" << r.nodes << '}';
+    }
+    return out.str();
+}
+
+static void batch_worker(BatchPipeline& pl, const BatchOptions& opts) {
+    for (;;) {
+        BatchJob job;
+        {
+            std::unique_lock<std::mutex> lock(pl.mtx);
+            pl.jobs_cv.wait(lock, [&] {
+                return (!pl.jobs.empty() && pl.jobs.front().index < pl.next_write + opts.window) ||
+                       (pl.eof && pl.jobs.empty());
+            });
+            if (pl.jobs.empty()) return; // eof and drained
+            job = std::move(pl.jobs.front());
+            pl.jobs.pop_front();
+        }
+        pl.space_cv.notify_one();
+
+        std::string result = analyse(job, opts);
+
+        {
+            std::lock_guard<std::mutex> lock(pl.mtx);
+            size_t slot = job.index % opts.window;
+            pl.ring[slot] = std::move(result);
+            pl.ready[slot] = true;
+        }
+        pl.done_cv.notify_one();
+    }
+}
+
+static void batch_writer(BatchPipeline& pl, const BatchOptions& opts, std::ostream& out, Clock::time_point start) {
+    auto lastReport = start;
+    for (;;) {
+        std::string line;
+        {
+            std::unique_lock<std::mutex> lock(pl.mtx);
+            size_t slot = pl.next_write % opts.window;
+            pl.done_cv.wait(lock, [&] { return pl.ready[slot] || (pl.eof && pl.next_write == pl.total); });
+            if (!pl.ready[slot]) return; // Everything written
+            line = std::move(pl.ring[slot]);
+            pl.ring[slot].clear();
+            pl.ready[slot] = false;
+            pl.next_write++;
+        }
+        // The slot is free again, a worker waiting on the window may go on
+        pl.jobs_cv.notify_all();
+        out << line << '\n';
+
+        auto now = Clock::now();
+        if (now - lastReport >= std::chrono::seconds(5)) {
+            lastReport = now;
+            double s = std::chrono::duration<double>(now - start).count();
+            std::cout << "info string batch " << pl.next_write << " positions " << (uint64_t)(pl.next_write / s) << " pos/s"
+                      << std::endl;
+        }
+    }
+}
+
+bool run_batch(const BatchOptions& opts, std::string& error) {
+    std::ifstream in(opts.input);
+    if (!in) {
+        error = "cannot open " + opts.input;
+        return false;
+    }
+    std::ofstream out(opts.output);
+    if (!out) {
+        error = "cannot write " + opts.output;
+        return false;
+    }
+    if (opts.csv)
+        out << (opts.perft_depth ? "line,fen,id,perft_depth,nodes,error\n" : "line,fen,id,bestmove,cp,mate,depth,nodes,result,error\n");
+
+    BatchPipeline pl;
+    pl.ring.resize(opts.window);
+    pl.ready.assign(opts.window, false);
+    if (opts.hash_mb) TT.resize(opts.hash_mb, opts.threads);
+    // Every worker searches with limits.age_tt off: one age for the run, not a bump per line
+    // from several threads at once
+    if (!opts.perft_depth) TT.new_search();
+
+    auto start = Clock::now();
+    std::vector<std::thread> workers;
+    for (int i = 0; i < opts.threads; i++) workers.emplace_back(batch_worker, std::ref(pl), std::cref(opts));
+    std::thread writer(batch_writer, std::ref(pl), std::cref(opts), std::ref(out), start);
+
+    std::string line;
+    uint64_t lineNo = 0;
+    // "stop" from the UCI reader ends the run early: nothing more is read, lines in flight
+    // are written with a "stopped" error
+    while (!Signals.stop.load(std::memory_order_relaxed) && std::getline(in, line)) {
+        lineNo++;
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#') continue; // Blank or comment
+        if (line.back() == '\r') line.pop_back();
+
+        std::unique_lock<std::mutex> lock(pl.mtx);
+        pl.space_cv.wait(lock, [&] { return pl.jobs.size() < opts.window; });
+        pl.jobs.push_back({ pl.total++, lineNo, std::move(line) });
+        lock.unlock();
+        pl.jobs_cv.notify_one();
+    }
+    {
+        std::lock_guard<std::mutex> lock(pl.mtx);
+        pl.eof = true;
+    }
+    pl.jobs_cv.notify_all();
+    pl.done_cv.notify_all();
+
+    for (std::thread& w : workers) w.join();
+    writer.join();
+    out.flush();
+
+    int64_t ms = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count();
+    std::cout << "info string batch done " << pl.total << " positions in " << ms << " ms, "
+              << pl.total * 1000 / (uint64_t)(ms + 1) << " pos/s" << std::endl;
+    if (!out) {
+        error = "write failed for " + opts.output;
+        return false;
+    }
+    return true;
+}
+
+bool batch_command(std::istringstream& args) {
+    BatchOptions opts;
+    opts.threads = (int)std::max(1u, std::thread::hardware_concurrency());
+    args >> opts.input >> opts.output;
+    std::string tok;
+    while (args >> tok) {
+        if (tok == "depth") args >> opts.depth;
+        else if (tok == "nodes") args >> opts.nodes;
+        else if (tok == "perft") args >> opts.perft_depth;
+        else if (tok == "threads") args >> opts.threads;
+        else if (tok == "window") args >> opts.window;
+        else if (tok == "hash") args >> opts.hash_mb;
+        else if (tok == "csv") opts.csv = true;
+        else if (tok == "jsonl") opts.csv = false;
+    }
+    if (opts.output.empty()) {
+        std::cout << "usage: batch <in.epd> <out> [depth D | nodes N | perft D] [threads N] [csv|jsonl] [window N] [hash MB]" << std::endl;
+        return false;
+    }
+    if (!opts.depth && !opts.nodes && !opts.perft_depth) opts.depth = 6;
+    opts.threads = std::max(1, opts.threads);
+    opts.window = std::max<size_t>(opts.window, 1);
+
+    std::string error;
+    if (!run_batch(opts, error)) {
+        std::cout << "batch failed: " << error << std::endl;
+        return false;
+    }
+    return true;
+}
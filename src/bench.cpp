@@ -0,0 +1,243 @@
+// chessbot_bench: ns/op for the core board primitives in isolation, over a fixed set of
+// positions, so a change to movegen or make/undo can be measured without running a search.
+//
+//   chessbot_bench [--reps N] [--min-time MS] [--warmup MS] [--filter TEXT] [--json FILE|-]
+//
+// Each primitive is warmed up, then timed --reps times. Each repetition runs at least
+// --min-time ms. The table (or the JSON, for tracking across commits) gives the median,
+// mean, min and stddev of ns/op over the repetitions, plus ops/sec from the median.
+#include "defs.h"
+#include "position.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Openings, middlegames with castling/ep/promotions available, and sparse endgames, so no
+// single code path dominates. Changing this list changes every number: don't, casually.
+static const char* BENCH_FENS[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+    "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+    "r1bqkb1r/pppp1ppp/2n2n2/4p2Q/2B1P3/8/PPPP1PPP/RNB1K1NR w KQkq - 4 4",
+    "rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3",
+    "2r3k1/pp3ppp/2n1b3/q2pP3/3P4/P1rB1N2/5PPP/R2Q1RK1 w - - 0 18",
+    "8/8/4k3/3p4/3P4/4K3/8/8 w - - 0 1",
+    "8/5pk1/6p1/8/4Q3/6P1/5PK1/q7 b - - 0 45",
+    "4k3/1P6/8/8/8/8/6p1/4K3 w - - 0 1",
+};
+
+struct BenchOptions {
+    int reps = 10;
+    double minTimeMs = 100;
+    double warmupMs = 200;
+    std::string filter;
+    std::string jsonPath; // Empty: table on stdout, "-": JSON on stdout
+};
+
+// One primitive: run() does a single pass over the corpus and returns how many
+// operations that was. The result goes into a sink so the work can't be optimised out.
+struct Bench {
+    const char* name;
+    const char* unit;
+    std::function<uint64_t()> run;
+};
+
+struct BenchResult {
+    const char* name;
+    const char* unit;
+    uint64_t opsPerRep = 0;
+    double median = 0, mean = 0, min = 0, stddev = 0; // ns/op
+};
+
+static volatile uint64_t sink;
+
+static double now_ns() {
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Passes needed to fill ms, from how long the warmup took per pass
+static uint64_t passes_for(double ms, double nsPerPass) {
+    return std::max<uint64_t>(1, (uint64_t)std::ceil(ms * 1e6 / std::max(nsPerPass, 1.0)));
+}
+
+static BenchResult run_bench(const Bench& b, const BenchOptions& opts) {
+    BenchResult r{ b.name, b.unit };
+
+    // Warm caches, branch predictors and the clock, and size a repetition from it
+    uint64_t passes = 0, ops = 0;
+    double start = now_ns(), elapsed = 0;
+    do {
+        ops += b.run();
+        passes++;
+        elapsed = now_ns() - start;
+    } while (elapsed < opts.warmupMs * 1e6);
+    uint64_t repPasses = passes_for(opts.minTimeMs, elapsed / (double)passes);
+    uint64_t opsPerPass = ops / passes;
+
+    std::vector<double> samples;
+    for (int i = 0; i < opts.reps; i++) {
+        uint64_t repOps = 0;
+        double t0 = now_ns();
+        for (uint64_t p = 0; p < repPasses; p++) repOps += b.run();
+        samples.push_back((now_ns() - t0) / (double)std::max<uint64_t>(repOps, 1));
+    }
+
+    std::sort(samples.begin(), samples.end());
+    size_t n = samples.size();
+    r.opsPerRep = opsPerPass * repPasses;
+    r.median = n % 2 ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+    r.min = samples[0];
+    for (double s : samples) r.mean += s;
+    r.mean /= (double)n;
+    for (double s : samples) r.stddev += (s - r.mean) * (s - r.mean);
+    r.stddev = n > 1 ? std::sqrt(r.stddev / (double)(n - 1)) : 0;
+    return r;
+}
+
+static void print_table(const std::vector<BenchResult>& results, const BenchOptions& opts) {
+    std::printf("%-20s %-8s %10s %10s %10s %8s %14s\n", "benchmark", "unit", "median ns", "mean ns", "min ns",
+                "stddev%", "ops/sec");
+    for (const BenchResult& r : results)
+        std::printf("%-20s %-8s %10.2f %10.2f %10.2f %7.2f%% %14.0f\n", r.name, r.unit, r.median, r.mean, r.min,
+                    r.mean > 0 ? 100 * r.stddev / r.mean : 0.0, r.median > 0 ? 1e9 / r.median : 0.0);
+    std::printf("%d reps of >= %.0f ms each after %.0f ms warmup, %zu positions\n", opts.reps, opts.minTimeMs,
+                opts.warmupMs, std::size(BENCH_FENS));
+}
+
+static void write_json(std::ostream& out, const std::vector<BenchResult>& results, const BenchOptions& opts) {
+    out.precision(10);
+    out << "{\n  \"positions\": " << std::size(BENCH_FENS) << ",\n  \"reps\": " << opts.reps
+        << ",\n  \"min_time_ms\": " << opts.minTimeMs << ",\n  \"warmup_ms\": " << opts.warmupMs
+        << ",\n  \"benchmarks\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        out << (i ? "," : "") << "\n    {\"name\": \"" << r.name << "\", \"unit\": \"" << r.unit
+            << "\", \"ops_per_rep\": " << r.opsPerRep << ", \"median_ns\": " << r.median << ", \"mean_ns\": " << r.mean
+            << ", \"min_ns\": " << r.min << ", \"stddev_ns\": " << r.stddev
+            << ", \"ops_per_sec\": " << (r.median > 0 ? 1e9 / r.median : 0.0) << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+static bool parse_args(int argc, char** argv, BenchOptions& opts) {
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (a == "--reps" && hasValue) opts.reps = std::max(1, std::atoi(argv[++i]));
+        else if (a == "--min-time" && hasValue) opts.minTimeMs = std::max(1.0, std::atof(argv[++i]));
+        else if (a == "--warmup" && hasValue) opts.warmupMs = std::max(0.0, std::atof(argv[++i]));
+        else if (a == "--filter" && hasValue) opts.filter = argv[++i];
+        else if (a == "--json" && hasValue) opts.jsonPath = argv[++i];
+        else {
+            std::cerr << "usage: chessbot_bench [--reps N] [--min-time MS] [--warmup MS] [--filter TEXT] [--json FILE|-]"
+                      << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    BenchOptions opts;
+    if (!parse_args(argc, argv, opts)) return 1;
+    init();
+
+    // Positions are big (the undo stack is a fixed array), so they live on the heap
+    std::vector<Position> positions(std::size(BENCH_FENS));
+    std::vector<MoveList> legal(positions.size());
+    for (size_t i = 0; i < positions.size(); i++) {
+        if (!positions[i].set_fen(BENCH_FENS[i])) {
+            std::cerr << "bad bench fen: " << BENCH_FENS[i] << std::endl;
+            return 1;
+        }
+        positions[i].gen_legal_moves(legal[i]);
+    }
+    auto scratch = std::make_unique<Position>();
+
+    const Bench benches[] = {
+        { "gen_moves", "position", [&] {
+              uint64_t n = 0;
+              for (const Position& pos : positions) {
+                  MoveList list;
+                  pos.gen_moves(list);
+                  n += (uint64_t)list.count;
+              }
+              sink = sink + n;
+              return (uint64_t)positions.size();
+          } },
+        { "gen_legal_moves", "position", [&] {
+              uint64_t n = 0;
+              for (Position& pos : positions) {
+                  MoveList list;
+                  pos.gen_legal_moves(list);
+                  n += (uint64_t)list.count;
+              }
+              sink = sink + n;
+              return (uint64_t)positions.size();
+          } },
+        // Every legal move of every position, made and taken back: one op is the pair
+        { "make_undo_move", "move", [&] {
+              uint64_t ops = 0, keys = 0;
+              for (size_t i = 0; i < positions.size(); i++)
+                  for (int j = 0; j < legal[i].count; j++) {
+                      positions[i].make_move(legal[i].moves[j]);
+                      keys += positions[i].key();
+                      positions[i].undo_move();
+                      ops++;
+                  }
+              sink = sink + keys;
+              return ops;
+          } },
+        // Both sides on every square
+        { "is_square_attacked", "query", [&] {
+              uint64_t hits = 0;
+              for (const Position& pos : positions)
+                  for (int s = 0; s < 64; s++) hits += pos.is_square_attacked(s, WHITE) + pos.is_square_attacked(s, BLACK);
+              sink = sink + hits;
+              return (uint64_t)positions.size() * 128;
+          } },
+        { "set_fen", "fen", [&] {
+              uint64_t keys = 0;
+              for (const char* fen : BENCH_FENS) {
+                  scratch->set_fen(fen);
+                  keys += scratch->key();
+              }
+              sink = sink + keys;
+              return (uint64_t)std::size(BENCH_FENS);
+          } },
+    };
+
+    std::vector<BenchResult> results;
+    for (const Bench& b : benches) {
+        if (!opts.filter.empty() && !std::strstr(b.name, opts.filter.c_str())) continue;
+        results.push_back(run_bench(b, opts));
+        if (opts.jsonPath.empty()) std::cerr << "." << std::flush; // Progress: a full run takes a few seconds
+    }
+    if (opts.jsonPath.empty()) std::cerr << std::endl;
+
+    if (opts.jsonPath.empty()) print_table(results, opts);
+    else if (opts.jsonPath == "-") write_json(std::cout, results, opts);
+    else {
+        std::ofstream out(opts.jsonPath);
+        if (!out) {
+            std::cerr << "cannot write " << opts.jsonPath << std::endl;
+            return 1;
+        }
+        write_json(out, results, opts);
+    }
+    return 0;
+}
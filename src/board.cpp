@@ -1,23 +1,42 @@
-#include "defs.h"
-
+#include "position.h"
+#include "eval.h"
+#include "pawns.h"
+#include "book.h"
+#include "stats.h"
+
+#include <algorithm>
+#include <cassert>
 #include <vector>
 #include <string>
 #include <cstdlib>
 #include <cstdint>
 
-// It should be noted to avoid any confusion that this is flipped from the display.
-// White appears on the bottom when asking for a board display (cmd d), but white is at the top of this array.
-int board[64] = {0};
-int side_to_move = WHITE;
+uint64_t ZOBRIST_PIECE[PIECE_NB][64];
+uint64_t ZOBRIST_CASTLING[16];
+uint64_t ZOBRIST_EP[8];
+uint64_t ZOBRIST_SIDE;
+
+// Fixed seed so keys (and anything cached under them) are the same on every run
+static void init_zobrist() {
+    uint64_t s = 0x2545F4914F6CDD1DULL;
+    auto next = [&s]() {
+        s ^= s >> 12; s ^= s << 25; s ^= s >> 27;
+        return s * 2685821657736338717ULL;
+    };
+    for (auto& row : ZOBRIST_PIECE)
+        for (uint64_t& k : row) k = next();
+    for (uint64_t& k : ZOBRIST_CASTLING) k = next();
+    for (uint64_t& k : ZOBRIST_EP) k = next();
+    ZOBRIST_SIDE = next();
+}
 
-// Bitmask: KQkq (white kingside, queenside, then black kingside, queenside)
-static int castling_rights = 0;
-// En passant tracker
-static int ep_square = -1;
-// From what I've seen a vector technically (?) be better than stack or deque here:
-static std::vector<Undo> history;
+Position::Position() {
+    for (int i = 0; i < 64; ++i) board[i] = EMPTY;
+    for (Bitboard& b : piece_bb) b = 0;
+    side_bb[WHITE] = side_bb[BLACK] = 0;
+}
 
-void clear_history() {
+void Position::clear_history() {
     history.clear();
 }
 
@@ -47,7 +66,6 @@ static int char_to_piece(char c) {
 int sq(int file, int rank) { return rank * 8 + file; }
 
 static int file_of(int sq) { return sq & 7; }   // And by 7 (range is 0-7 inclusive) to find file
-static int rank_of(int sq) { return sq >> 3; }  // Rightshift 3 bits to find rank
 
 // Validate square passed by character value of file (a-h) and rank (1-8)
 int parse_square(const char fileChar, const char rankChar) {
@@ -58,438 +76,517 @@ int parse_square(const char fileChar, const char rankChar) {
     return sq(file, rank);
 }
 
-// Movegen helpers
-static bool is_white(int p) {
-    return p == WP || p == WN || p == WB || p == WR || p == WQ || p == WK;
-}
-static bool is_black(int p) {
-    return p == BP || p == BN || p == BB || p == BR || p == BQ || p == BK;
+void Position::put_piece(int p, int s) {
+    board[s] = (uint8_t)p;
+    hash_key ^= ZOBRIST_PIECE[p][s];
+    if (piece_type(p) == PAWN) pawn_hash ^= ZOBRIST_PIECE[p][s];
+    else if (piece_type(p) == KING) king_sq[piece_side(p)] = s;
+    mg_sum += PSQ_MG[p][s];
+    eg_sum += PSQ_EG[p][s];
+    game_phase += PHASE_WEIGHT[p];
+    piece_bb[p] |= square_bb(s);
+    side_bb[piece_side(p)] |= square_bb(s);
 }
 
-static bool same_side(int p, int side) {
-    return (side == WHITE) ? is_white(p) : is_black(p);
+void Position::remove_piece(int s) {
+    int p = board[s];
+    board[s] = EMPTY;
+    hash_key ^= ZOBRIST_PIECE[p][s];
+    if (piece_type(p) == PAWN) pawn_hash ^= ZOBRIST_PIECE[p][s];
+    else if (piece_type(p) == KING) king_sq[piece_side(p)] = -1;
+    mg_sum -= PSQ_MG[p][s];
+    eg_sum -= PSQ_EG[p][s];
+    game_phase -= PHASE_WEIGHT[p];
+    piece_bb[p] &= ~square_bb(s);
+    side_bb[piece_side(p)] &= ~square_bb(s);
 }
 
-static bool enemy_side(int p, int side) {
-    return (side == WHITE) ? is_black(p) : is_white(p);
+void Position::move_piece(int from, int to) {
+    int p = board[from];
+    Bitboard fromTo = square_bb(from) | square_bb(to);
+    board[from] = EMPTY;
+    board[to] = (uint8_t)p;
+    hash_key ^= ZOBRIST_PIECE[p][from] ^ ZOBRIST_PIECE[p][to];
+    if (piece_type(p) == PAWN) pawn_hash ^= ZOBRIST_PIECE[p][from] ^ ZOBRIST_PIECE[p][to];
+    else if (piece_type(p) == KING) king_sq[piece_side(p)] = to;
+    mg_sum += PSQ_MG[p][to] - PSQ_MG[p][from];
+    eg_sum += PSQ_EG[p][to] - PSQ_EG[p][from];
+    piece_bb[p] ^= fromTo;
+    side_bb[piece_side(p)] ^= fromTo;
 }
 
-// Movegen
-static const int KNIGHT_DF[8] = { +1, +2, +2, +1, -1, -2, -2, -1 };
-static const int KNIGHT_DR[8] = { +2, +1, -1, -2, -2, -1, +1, +2 };
-
-static const int KING_DF[8] = { -1,  0, +1, -1, +1, -1,  0, +1 };
-static const int KING_DR[8] = { -1, -1, -1,  0,  0, +1, +1, +1 };
-
-static const int BISHOP_DF[4] = { +1, -1, +1, -1 };
-static const int BISHOP_DR[4] = { +1, +1, -1, -1 };
-
-static const int ROOK_DF[4] = {  0,  0, +1, -1 };
-static const int ROOK_DR[4] = { +1, -1,  0,  0 };
+// The ep square only goes into the key when the side to move could actually take on it,
+// otherwise the same position would hash differently depending on how it was reached.
+bool Position::ep_capturable() const {
+    return ep_square >= 0 && (PAWN_ATTACKS[stm ^ 1][ep_square] & pieces(stm, PAWN));
+}
 
-static const int QUEEN_DF[8] = {  0,  0, +1, -1, +1, -1, +1, -1 };
-static const int QUEEN_DR[8] = { +1, -1,  0,  0, +1, +1, -1, -1 };
+uint64_t Position::compute_key() const {
+    uint64_t k = 0;
+    for (int s = 0; s < 64; s++) {
+        if (board[s] != EMPTY) k ^= ZOBRIST_PIECE[board[s]][s];
+    }
+    if (stm == BLACK) k ^= ZOBRIST_SIDE;
+    k ^= ZOBRIST_CASTLING[castling_rights];
+    if (ep_capturable()) k ^= ZOBRIST_EP[ep_square & 7];
+    return k;
+}
 
-static int find_king_square(int side) {
-    int king = (side == WHITE) ? WK : BK;
-    for (int i = 0; i < 64; i++) {
-        if (board[i] == king) return i;
+uint64_t Position::compute_pawn_key() const {
+    uint64_t k = 0;
+    for (int p : { WP, BP }) {
+        Bitboard b = piece_bb[p];
+        while (b) k ^= ZOBRIST_PIECE[p][pop_lsb(b)];
     }
-    return -1; // Should never happen if a position is valid
+    return k;
 }
 
-// Return true if at any point an attack upon this square is found
-static bool is_square_attacked(int targetSq, int bySide) {
-    int fromF = file_of(targetSq);
-    int fromR = rank_of(targetSq);
-
-    // Pawn
-    if (bySide == WHITE) {
-        // White pawn attacks come from (file-1, rank-1) and (file+1, rank-1)
-        if (fromR > 0) {
-            if (fromF > 0) {
-                int to = sq(fromF - 1, fromR - 1);
-                if (board[to] == WP) return true;
-            }
-            if (fromF < 7) {
-                int to = sq(fromF + 1, fromR - 1);
-                if (board[to] == WP) return true;
-            }
-        }
-    } else {
-        // Black pawns (inverse logic)
-        if (fromR < 7) {
-            if (fromF > 0) {
-                int to = sq(fromF - 1, fromR + 1);
-                if (board[to] == BP) return true;
-            }
-            if (fromF < 7) {
-                int to = sq(fromF + 1, fromR + 1);
-                if (board[to] == BP) return true;
-            }
-        }
+// True if the current position already occurred with the same side to move. Walks back
+// through the undo history only as far as the last capture or pawn move, since nothing
+// before one of those can come back.
+bool Position::is_repetition() const {
+    int n = (int)history.size();
+    for (int j = n - 1; j >= 0; j--) {
+        const Undo& u = history[j];
+        if (u.captured != EMPTY || u.moved == WP || u.moved == BP) break;
+        if ((n - j) % 2 == 0 && u.prev_key == hash_key) return true;
     }
+    return false;
+}
 
-    // Knight
-    {
-        int knight = (bySide == WHITE) ? WN : BN;
-        for (int i = 0; i < 8; i++) {
-            int f = fromF + KNIGHT_DF[i];
-            int r = fromR + KNIGHT_DR[i];
-            if (f < 0 || f >= 8 || r < 0 || r >= 8) continue;
+// Return true if at any point an attack upon this square is found
+bool Position::is_square_attacked(int targetSq, int bySide) const {
+    Bitboard occ = occupied();
+    // A pawn of bySide attacks targetSq exactly when a pawn of the other side on targetSq would attack it
+    if (PAWN_ATTACKS[bySide ^ 1][targetSq] & pieces(bySide, PAWN)) return true;
+    if (KNIGHT_ATTACKS[targetSq] & pieces(bySide, KNIGHT)) return true;
+    if (KING_ATTACKS[targetSq] & pieces(bySide, KING)) return true;
+
+    Bitboard queens = pieces(bySide, QUEEN);
+    if (bishop_attacks(targetSq, occ) & (pieces(bySide, BISHOP) | queens)) return true;
+    if (rook_attacks(targetSq, occ) & (pieces(bySide, ROOK) | queens)) return true;
+    return false; // Not under attack
+}
 
-            int to = sq(f, r);
-            if (board[to] == knight) return true;
-        }
-    }
+bool Position::is_in_check(int side) const {
+    if (king_sq[side] < 0) return false; // Should never happen if a position is valid
+    return is_square_attacked(king_sq[side], side ^ 1);
+}
 
-    // King
-    {
-        int king = (bySide == WHITE) ? WK : BK;
-        for (int i = 0; i < 8; i++) {
-            int f = fromF + KING_DF[i];
-            int r = fromR + KING_DR[i];
-            if (f < 0 || f >= 8 || r < 0 || r >= 8) continue;
+// Pieces of both sides attacking s, with a caller-supplied occupancy so sliders can be
+// looked at "through" a piece that is about to move
+Bitboard Position::attackers_to(int s, Bitboard occ) const {
+    Bitboard diag = piece_bb[WB] | piece_bb[BB] | piece_bb[WQ] | piece_bb[BQ];
+    Bitboard orth = piece_bb[WR] | piece_bb[BR] | piece_bb[WQ] | piece_bb[BQ];
+    return (PAWN_ATTACKS[BLACK][s] & piece_bb[WP])
+         | (PAWN_ATTACKS[WHITE][s] & piece_bb[BP])
+         | (KNIGHT_ATTACKS[s] & (piece_bb[WN] | piece_bb[BN]))
+         | (KING_ATTACKS[s] & (piece_bb[WK] | piece_bb[BK]))
+         | (bishop_attacks(s, occ) & diag)
+         | (rook_attacks(s, occ) & orth);
+}
 
-            int to = sq(f, r);
-            if (board[to] == king) return true;
-        }
+// Pieces of `side` that are the only thing between their own king and an enemy slider
+Bitboard Position::pinned_pieces(int side) const {
+    int ksq = king_sq[side];
+    if (ksq < 0) return 0;
+    int them = side ^ 1;
+    Bitboard queens = pieces(them, QUEEN);
+    Bitboard snipers = (ROOK_RAYS[ksq] & (pieces(them, ROOK) | queens)) |
+                       (BISHOP_RAYS[ksq] & (pieces(them, BISHOP) | queens));
+    Bitboard occ = occupied();
+    Bitboard pinned = 0;
+
+    while (snipers) {
+        Bitboard between = BETWEEN[ksq][pop_lsb(snipers)] & occ;
+        if (between && !(between & (between - 1))) pinned |= between & side_bb[side];
     }
+    return pinned;
+}
 
-    // Diagonals (Bishop, queen)
-    {
-        int bishop = (bySide == WHITE) ? WB : BB;
-        int queen  = (bySide == WHITE) ? WQ : BQ;
+// En passant removes two pawns from the same rank at once, which pins can't describe,
+// so just look at the king's attackers on the board as it will be after the capture
+bool Position::ep_is_legal(int from) const {
+    int us = piece_side(board[from]);
+    if (king_sq[us] < 0) return true;
+    int capSq = (us == WHITE) ? ep_square - 8 : ep_square + 8;
+    Bitboard occ = (occupied() ^ square_bb(from) ^ square_bb(capSq)) | square_bb(ep_square);
+    return !(attackers_to(king_sq[us], occ) & side_bb[us ^ 1] & ~square_bb(capSq));
+}
 
-        for (int d = 0; d < 4; d++) {
-            int f = fromF + BISHOP_DF[d];
-            int r = fromR + BISHOP_DR[d];
+static void add_move(MoveList& list, int from, int to, int flag = MOVE_NORMAL) {
+    list.moves[list.count++] = Move(from, to, flag);
+}
 
-            while (f >= 0 && f < 8 && r >= 0 && r < 8) {
-                int to = sq(f, r);
-                int target = board[to];
+// One move per target square, all sharing the same from square
+static void add_moves(MoveList& list, int from, Bitboard targets) {
+    while (targets) add_move(list, from, pop_lsb(targets));
+}
 
-                if (target != EMPTY) {
-                    if (target == bishop || target == queen) return true;
-                    break;
-                }
+// Pawn moves are generated set-wise; delta is (to - from) for every bit in targets
+static void add_pawn_moves(MoveList& list, Bitboard targets, int delta) {
+    Bitboard promos = targets & (RANK_1_BB | RANK_8_BB);
+    targets &= ~promos;
 
-                f += BISHOP_DF[d];
-                r += BISHOP_DR[d];
-            }
-        }
+    while (targets) {
+        int to = pop_lsb(targets);
+        add_move(list, to - delta, to);
     }
+    while (promos) {
+        int to = pop_lsb(promos);
+        for (int type = QUEEN; type >= KNIGHT; type--)
+            list.moves[list.count++] = Move::promotion(to - delta, to, type);
+    }
+}
 
-    // Orthogonal (Rook, queen)
-    {
-        int rook  = (bySide == WHITE) ? WR : BR;
-        int queen = (bySide == WHITE) ? WQ : BQ;
-
-        for (int d = 0; d < 4; d++) {
-            int f = fromF + ROOK_DF[d];
-            int r = fromR + ROOK_DR[d];
-
-            while (f >= 0 && f < 8 && r >= 0 && r < 8) {
-                int to = sq(f, r);
-                int target = board[to];
+// target: squares a move may land on (everything not ours, or the check-blocking mask)
+// pinned: our pieces that may only move along the line to our king
+void Position::gen_pawn_moves(MoveList& list, int side, Bitboard target, Bitboard pinned) const {
+    Bitboard pawns = pieces(side, PAWN);
+    Bitboard free = pawns & ~pinned;
+    Bitboard enemy = side_bb[side ^ 1] & target;
+    Bitboard empty = ~occupied();
 
-                if (target != EMPTY) {
-                    if (target == rook || target == queen) return true;
-                    break;
-                }
+    if (side == WHITE) {
+        Bitboard one = shift_north(free) & empty;
+        Bitboard two = shift_north(one & RANK_3_BB) & empty & target; // Double push from rank 2
+        add_pawn_moves(list, one & target, 8);
+        add_pawn_moves(list, two, 16);
+        add_pawn_moves(list, shift_north_west(free) & enemy, 7);
+        add_pawn_moves(list, shift_north_east(free) & enemy, 9);
+    } else { // Black pieces (same logic as white, shifting down instead of up).
+        Bitboard one = shift_south(free) & empty;
+        Bitboard two = shift_south(one & RANK_6_BB) & empty & target;
+        add_pawn_moves(list, one & target, -8);
+        add_pawn_moves(list, two, -16);
+        add_pawn_moves(list, shift_south_west(free) & enemy, -9);
+        add_pawn_moves(list, shift_south_east(free) & enemy, -7);
+    }
 
-                f += ROOK_DF[d];
-                r += ROOK_DR[d];
+    // Pinned pawns one at a time, restricted to the pin line
+    Bitboard stuck = pawns & pinned;
+    if (stuck) {
+        int ksq = king_sq[side];
+        int up = (side == WHITE) ? 8 : -8;
+        Bitboard startRank = (side == WHITE) ? RANK_2_BB : RANK_7_BB;
+        while (stuck) {
+            int from = pop_lsb(stuck);
+            assert(from + up >= 0 && from + up < 64); // is_sane keeps pawns off the back ranks
+            Bitboard moves = PAWN_ATTACKS[side][from] & enemy;
+            if (empty & square_bb(from + up)) {
+                moves |= square_bb(from + up) & target;
+                if ((startRank & square_bb(from)) && (empty & square_bb(from + 2 * up)))
+                    moves |= square_bb(from + 2 * up) & target;
+            }
+            moves &= LINE[ksq][from];
+            while (moves) {
+                int to = pop_lsb(moves);
+                add_pawn_moves(list, square_bb(to), to - from);
             }
         }
     }
-    return false; // Not under attack
 }
 
-static bool is_in_check(int side) {
-    int kingSq = find_king_square(side);
-    if (kingSq < 0) return false; // or assert(false) if you prefer
-    int attackerSide = (side == WHITE) ? BLACK : WHITE;
-    return is_square_attacked(kingSq, attackerSide);
+// Ep captures land on an empty square, so no target mask describes them; the capture
+// stage asks for them separately
+void Position::gen_ep_captures(MoveList& list, int side, bool legal) const {
+    if (ep_square < 0) return;
+    // Our pawns that could capture onto the ep square are the ones an enemy pawn there would attack
+    Bitboard attackers = PAWN_ATTACKS[side ^ 1][ep_square] & pieces(side, PAWN);
+    while (attackers) {
+        int from = pop_lsb(attackers);
+        if (!legal || ep_is_legal(from)) add_move(list, from, ep_square, MOVE_EP);
+    }
 }
 
-static void add_move(MoveList& list, int from, int to, int promo = 0) {
-    Move m;
-    m.from = (uint8_t)from;
-    m.to = (uint8_t)to;
-    m.promo = (uint8_t)promo;
-    list.moves[list.count++] = m;
+void Position::gen_piece_moves(MoveList& list, int side, Bitboard target, Bitboard pinned) const {
+    Bitboard occ = occupied();
+    int ksq = king_sq[side];
+
+    // A pinned knight can never stay on the pin line
+    Bitboard b = pieces(side, KNIGHT) & ~pinned;
+    while (b) {
+        int from = pop_lsb(b);
+        add_moves(list, from, KNIGHT_ATTACKS[from] & target);
+    }
+    b = pieces(side, BISHOP);
+    while (b) {
+        int from = pop_lsb(b);
+        Bitboard t = (pinned & square_bb(from)) ? target & LINE[ksq][from] : target;
+        add_moves(list, from, bishop_attacks(from, occ) & t);
+    }
+    b = pieces(side, ROOK);
+    while (b) {
+        int from = pop_lsb(b);
+        Bitboard t = (pinned & square_bb(from)) ? target & LINE[ksq][from] : target;
+        add_moves(list, from, rook_attacks(from, occ) & t);
+    }
+    b = pieces(side, QUEEN);
+    while (b) {
+        int from = pop_lsb(b);
+        Bitboard t = (pinned & square_bb(from)) ? target & LINE[ksq][from] : target;
+        add_moves(list, from, queen_attacks(from, occ) & t);
+    }
 }
 
-static void gen_pawn_moves(int from, MoveList& list, int side) {
-    int f = file_of(from);
-    int r = rank_of(from);
+// target: as above, but never narrowed by checks (the king steps out of them instead)
+// legal:  skip squares the enemy attacks
+void Position::gen_king_moves(MoveList& list, int side, Bitboard target, bool legal) const {
+    int from = king_sq[side];
+    if (from < 0) return;
+    Bitboard targets = KING_ATTACKS[from] & target;
 
-    // White pawns:
-    if (side == WHITE) {
-        int oneUp = from + 8; // Look one above
-        if (oneUp < 64 && board[oneUp] == EMPTY) {
-            // Pawn can promote if on rank 7 and the rank 8 slot above it is empty
-            if (r == 6) {
-                add_move(list, from, oneUp, WQ);
-                add_move(list, from, oneUp, WR);
-                add_move(list, from, oneUp, WB);
-                add_move(list, from, oneUp, WN);
-            } else { // No promo, just one step ahead is ok
-                add_move(list, from, oneUp, 0);
-
-                // Double push from rank 2
-                if (r == 1) {
-                    int twoUp = from + 16; // Look two ahead
-                    if (twoUp < 64 && board[twoUp] == EMPTY) {
-                        add_move(list, from, twoUp, 0);
-                    }
-                }
-            }
-        }
+    if (!legal) {
+        add_moves(list, from, targets);
+        return;
+    }
+    // Take the king off the board first so it can't hide behind itself from a slider
+    Bitboard occ = occupied() ^ square_bb(from);
+    while (targets) {
+        int to = pop_lsb(targets);
+        if (!(attackers_to(to, occ) & side_bb[side ^ 1])) add_move(list, from, to);
+    }
+}
 
-        // Captures
-        if (f > 0) { // If we can look to the left:
-            int cap = from + 7; // Look to the left and above
-            if (cap < 64 && enemy_side(board[cap], side)) {
-                if (r == 6) { // Add all promotion moves
-                    add_move(list, from, cap, WQ);
-                    add_move(list, from, cap, WR);
-                    add_move(list, from, cap, WB);
-                    add_move(list, from, cap, WN);
-                } else {
-                    add_move(list, from, cap, 0);
-                }
-            }
-            else if (cap == ep_square){
-                add_move(list, from, cap, 0);
+// Castling: caller makes sure we're not in check. Must not pass through attacked squares,
+// must have rook present, and squares between must be empty.
+void Position::gen_castling(MoveList& list, int side) const {
+    const int enemy = side ^ 1;
+    Bitboard occ = occupied();
+
+    if (side == WHITE && board[sq(4, 0)] == WK) { // e1
+        int from = sq(4, 0);
+        // Kingside: e1 -> g1, rook h1 -> f1
+        if (castling_rights & 1) {
+            if (board[sq(7,0)] == WR && // rook present
+                !(occ & (square_bb(sq(5,0)) | square_bb(sq(6,0)))) && // f1, g1 empty
+                !is_square_attacked(sq(5,0), enemy) && // f1 not attacked
+                !is_square_attacked(sq(6,0), enemy)) { // g1 not attacked
+                add_move(list, from, sq(6,0), MOVE_CASTLE); // e1g1
             }
         }
-        if (f < 7) { // If we can look to the right
-            int cap = from + 9; // Look above and to the right
-            if (cap < 64 && enemy_side(board[cap], side)) {
-                if (r == 6) { // Does this capture also promote the pawn?
-                    add_move(list, from, cap, WQ);
-                    add_move(list, from, cap, WR);
-                    add_move(list, from, cap, WB);
-                    add_move(list, from, cap, WN);
-                } else { // Just the capture move
-                    add_move(list, from, cap, 0);
-                }
-            }
-            else if (cap == ep_square) {
-                add_move(list, from, cap, 0);
+        // Queenside: e1 -> c1, rook a1 -> d1
+        if (castling_rights & 2) {
+            if (board[sq(0,0)] == WR && // rook present
+                !(occ & (square_bb(sq(1,0)) | square_bb(sq(2,0)) | square_bb(sq(3,0)))) && // b1, c1, d1 empty
+                !is_square_attacked(sq(3,0), enemy) && // d1 not attacked
+                !is_square_attacked(sq(2,0), enemy)) { // c1 not attacked
+                add_move(list, from, sq(2,0), MOVE_CASTLE); // e1c1
             }
         }
-    } else { // Black pieces (same logic as white, minus instead of plus for indexing).
-        int one = from - 8; // Look one below
-        if (one >= 0 && board[one] == EMPTY) {
-            if (r == 1) {
-                add_move(list, from, one, BQ);
-                add_move(list, from, one, BR);
-                add_move(list, from, one, BB);
-                add_move(list, from, one, BN);
-            } else {
-                add_move(list, from, one, 0);
-                if (r == 6) {
-                    int two = from - 16;
-                    if (two >= 0 && board[two] == EMPTY) {
-                        add_move(list, from, two, 0);
-                    }
-                }
+    } else if (side == BLACK && board[sq(4, 7)] == BK) { // e8
+        int from = sq(4, 7);
+        // Kingside: e8 -> g8, rook h8 -> f8
+        if (castling_rights & 4) {
+            if (board[sq(7,7)] == BR &&
+                !(occ & (square_bb(sq(5,7)) | square_bb(sq(6,7)))) &&
+                !is_square_attacked(sq(5,7), enemy) &&
+                !is_square_attacked(sq(6,7), enemy)) {
+                add_move(list, from, sq(6,7), MOVE_CASTLE); // e8g8
             }
         }
-
-        // Captures
-        if (f > 0) {
-            int cap = from - 9;
-            if (cap >= 0 && enemy_side(board[cap], side)) {
-                if (r == 1) {
-                    add_move(list, from, cap, BQ);
-                    add_move(list, from, cap, BR);
-                    add_move(list, from, cap, BB);
-                    add_move(list, from, cap, BN);
-                } else {
-                    add_move(list, from, cap, 0);
-                }
-            }
-            else if (cap == ep_square) {
-                add_move(list, from, cap, 0);
-            }
-        }
-        if (f < 7) {
-            int cap = from - 7;
-            if (cap >= 0 && enemy_side(board[cap], side)) {
-                if (r == 1) {
-                    add_move(list, from, cap, BQ);
-                    add_move(list, from, cap, BR);
-                    add_move(list, from, cap, BB);
-                    add_move(list, from, cap, BN);
-                } else {
-                    add_move(list, from, cap, 0);
-                }
-            }
-            else if (cap == ep_square) {
-                add_move(list, from, cap, 0);
+        // Queenside: e8 -> c8, rook a8 -> d8
+        if (castling_rights & 8) {
+            if (board[sq(0,7)] == BR &&
+                !(occ & (square_bb(sq(1,7)) | square_bb(sq(2,7)) | square_bb(sq(3,7)))) &&
+                !is_square_attacked(sq(3,7), enemy) &&
+                !is_square_attacked(sq(2,7), enemy)) {
+                add_move(list, from, sq(2,7), MOVE_CASTLE); // e8c8
             }
         }
     }
 }
 
-static void gen_slider_moves(int from, MoveList& list, int side,
-                             const int* DF, const int* DR, int dirCount) {
-    int fromF = file_of(from);
-    int fromR = rank_of(from);
-
-    for (int d = 0; d < dirCount; d++) {
-        int f = fromF + DF[d];
-        int r = fromR + DR[d];
-
-        while (f >= 0 && f < 8 && r >= 0 && r < 8) {
-            int to = sq(f, r);
-            int target = board[to];
-
-            if (target == EMPTY) {
-                add_move(list, from, to, 0);
-            } else {
-                if (enemy_side(target, side)) {
-                    add_move(list, from, to, 0);
-                }
-                break;
-            }
+// Pseudo-legal: may leave our own king in check
+void Position::gen_moves(MoveList& list) const {
+    list.count = 0;
+    Bitboard target = ~side_bb[stm];
+    gen_pawn_moves(list, stm, target, 0);
+    gen_ep_captures(list, stm, false);
+    gen_piece_moves(list, stm, target, 0);
+    gen_king_moves(list, stm, target, false);
+    // You cannot castle out of check
+    if (!is_in_check(stm)) gen_castling(list, stm);
+}
 
-            f += DF[d];
-            r += DR[d];
-        }
+// Checkers and pins are worked out once, then every generator only emits moves that
+// are legal as they stand, so nothing has to be made and unmade to test it.
+void Position::gen_legal_moves(MoveList& legal, GenType type) {
+    STATS_INC(movegen_calls);
+    STATS_TIME(movegen_ns);
+    legal.count = 0;
+    int ksq = king_sq[stm];
+    if (ksq < 0) { // Not a real game position, but don't crash on it
+        gen_moves(legal);
+        return;
+    }
+    Bitboard checkers = attackers_to(ksq, occupied()) & side_bb[stm ^ 1];
+    // Pawns only ever reach the last rank by promoting, so that rank is tactical for them alone
+    Bitboard promoRanks = RANK_1_BB | RANK_8_BB;
+    Bitboard stage = ~side_bb[stm], pawnStage = stage;
+    if (type == GEN_TACTICAL) {
+        stage = side_bb[stm ^ 1];
+        pawnStage = stage | (~occupied() & promoRanks);
+    } else if (type == GEN_QUIETS) {
+        stage = ~occupied();
+        pawnStage = stage & ~promoRanks;
     }
-}
 
-// Updated: Moves away from square delta check to mitigate reconverting file and rank:
-static void gen_knight_moves(int from, MoveList& list) {
-    int fromF = file_of(from);
-    int fromR = rank_of(from);
+    gen_king_moves(legal, stm, stage, true);
+    if (checkers & (checkers - 1)) return; // Double check: only the king can move
 
-    for (int i = 0; i < 8; i++) {
-        int f = fromF + KNIGHT_DF[i];
-        int r = fromR + KNIGHT_DR[i];
-        if (f < 0 || f >= 8 || r < 0 || r >= 8) continue;
+    // In check: capture the checker or block between it and the king
+    Bitboard target = checkers ? (BETWEEN[ksq][lsb(checkers)] | checkers) : ~side_bb[stm];
+    Bitboard pinned = pinned_pieces(stm);
 
-        int to = sq(f, r);
-        int target = board[to];
-        if (target != EMPTY && same_side(target, side_to_move)) continue;
-        // Passed all checks
-        add_move(list, from, to, 0);
-    }
+    gen_pawn_moves(legal, stm, target & pawnStage, pinned);
+    if (type != GEN_QUIETS) gen_ep_captures(legal, stm, true);
+    gen_piece_moves(legal, stm, target & stage, pinned);
+    if (!checkers && type != GEN_TACTICAL) gen_castling(legal, stm);
 }
 
-// Updated: Defined global DF and DR for sliding pieces, king and knight to pass:
-static void gen_bishop_moves(int from, MoveList& list, int side) {
-    gen_slider_moves(from, list, side, BISHOP_DF, BISHOP_DR, 4);
+bool Position::is_capture(const Move& m) const {
+    return board[m.to()] != EMPTY || m.is_ep();
 }
 
-static void gen_rook_moves(int from, MoveList& list, int side) {
-    gen_slider_moves(from, list, side, ROOK_DF, ROOK_DR, 4);
-}
+// Rough piece values for exchanges; the king only ever ends a sequence
+static const int SEE_VALUE[7] = { 0, 100, 320, 330, 500, 900, 20000 };
+
+// Static exchange evaluation: material we come out with if both sides keep recapturing on
+// m.to() with their least valuable attacker, each free to stop when that's better. Sliders
+// behind the pieces that have moved off join in through the occupancy; pins are ignored.
+int Position::see(const Move& m) const {
+    int from = m.from(), to = m.to();
+    int moved = piece_type(board[from]);
+    if (m.is_castle()) return 0;
+
+    Bitboard occ = occupied() ^ square_bb(from);
+    int gain[32];
+    int d = 0;
+    if (board[to] != EMPTY) {
+        gain[0] = SEE_VALUE[piece_type(board[to])];
+    } else if (m.is_ep()) {
+        gain[0] = SEE_VALUE[PAWN];
+        occ ^= square_bb(stm == WHITE ? to - 8 : to + 8);
+    } else {
+        gain[0] = 0;
+    }
+    // Value of whatever now stands on `to`, which is what the next capture wins
+    int onSquare = SEE_VALUE[moved];
+    if (m.is_promo()) {
+        gain[0] += SEE_VALUE[m.promo_type()] - SEE_VALUE[PAWN];
+        onSquare = SEE_VALUE[m.promo_type()];
+    }
 
-static void gen_queen_moves(int from, MoveList& list, int side) {
-    gen_slider_moves(from, list, side, QUEEN_DF, QUEEN_DR, 8);
-}
+    Bitboard diag = piece_bb[WB] | piece_bb[BB] | piece_bb[WQ] | piece_bb[BQ];
+    Bitboard orth = piece_bb[WR] | piece_bb[BR] | piece_bb[WQ] | piece_bb[BQ];
+    Bitboard attackers = attackers_to(to, occ) & occ;
+    bool promoSquare = square_bb(to) & (RANK_1_BB | RANK_8_BB);
+    int side = stm ^ 1;
+
+    while (d < 31) {
+        Bitboard ours = attackers & side_bb[side];
+        if (!ours) break;
+        int type = PAWN;
+        Bitboard b = 0;
+        for (; type <= KING; type++)
+            if ((b = ours & piece_bb[make_piece(side, type)])) break;
+        // The king can't take into a square the other side still covers
+        if (type == KING && (attackers & side_bb[side ^ 1])) break;
+
+        d++;
+        gain[d] = onSquare - gain[d - 1];
+        onSquare = SEE_VALUE[type];
+        if (type == PAWN && promoSquare) {
+            gain[d] += SEE_VALUE[QUEEN] - SEE_VALUE[PAWN];
+            onSquare = SEE_VALUE[QUEEN];
+        }
 
-static void gen_king_moves(int from, MoveList& list, int side) {
-    int fromF = file_of(from);
-    int fromR = rank_of(from);
+        occ ^= b & (0 - b);
+        if (type == PAWN || type == BISHOP || type == QUEEN) attackers |= bishop_attacks(to, occ) & diag;
+        if (type == ROOK || type == QUEEN) attackers |= rook_attacks(to, occ) & orth;
+        attackers &= occ;
+        side ^= 1;
+    }
+    while (d > 0) {
+        gain[d - 1] = -std::max(-gain[d - 1], gain[d]);
+        d--;
+    }
+    return gain[0];
+}
 
-    // Normal king moves
-    for (int i = 0; i < 8; i++) {
-        int f = fromF + KING_DF[i];
-        int r = fromR + KING_DR[i];
-        if (f < 0 || f >= 8 || r < 0 || r >= 8) continue;
+// Could m come out of gen_moves here? Checked straight against the board, so hash and
+// killer moves (which may come from some other position) can be tested without generating.
+bool Position::is_pseudo_legal(const Move& m) const {
+    int from = m.from(), to = m.to();
+    if (from == to) return false;
+    // 3 and anything past queen promotion are never generated (a TT collision can hold them)
+    if (m.flag() == 3 || m.flag() > MOVE_PROMO + 3) return false;
+    int p = board[from];
+    if (p == EMPTY || piece_side(p) != stm) return false;
+    if (board[to] != EMPTY && piece_side(board[to]) == stm) return false;
+
+    Bitboard toBB = square_bb(to);
+    Bitboard occ = occupied();
+    int type = piece_type(p);
+
+    if (m.is_castle()) {
+        // Rare, so just ask the castling generator
+        if (type != KING || is_in_check(stm)) return false;
+        MoveList castles;
+        gen_castling(castles, stm);
+        for (int i = 0; i < castles.count; i++)
+            if (castles.moves[i] == m) return true;
+        return false;
+    }
+    if (type != PAWN) {
+        if (m.flag() != MOVE_NORMAL) return false;
+        switch (type) {
+            case KNIGHT: return KNIGHT_ATTACKS[from] & toBB;
+            case BISHOP: return bishop_attacks(from, occ) & toBB;
+            case ROOK:   return rook_attacks(from, occ) & toBB;
+            case QUEEN:  return queen_attacks(from, occ) & toBB;
+            default:     return KING_ATTACKS[from] & toBB;
+        }
+    }
 
-        int to = sq(f, r);
-        int target = board[to];
-        if (target != EMPTY && same_side(target, side)) continue;
+    if (m.is_ep()) return to == ep_square && (PAWN_ATTACKS[stm][from] & toBB);
+    // Pawns must promote on the last rank, and only there
+    bool lastRank = toBB & (RANK_1_BB | RANK_8_BB);
+    if (lastRank != m.is_promo()) return false;
+
+    int up = stm == WHITE ? 8 : -8;
+    if (PAWN_ATTACKS[stm][from] & toBB) return board[to] != EMPTY;
+    if (to == from + up) return board[to] == EMPTY;
+    Bitboard startRank = stm == WHITE ? RANK_2_BB : RANK_7_BB;
+    return to == from + 2 * up && (startRank & square_bb(from)) &&
+           board[from + up] == EMPTY && board[to] == EMPTY;
+}
 
-        add_move(list, from, to, 0);
-    }
+// For a pseudo-legal m: does it leave our king safe? Same masks as gen_legal_moves.
+bool Position::is_legal(const Move& m) const {
+    int ksq = king_sq[stm];
+    if (ksq < 0) return true;
+    int from = m.from(), to = m.to();
 
-    // Castling: must not be in check, must not pass through attacked squares,
-    // must have rook present, and squares between must be empty.
-    const int enemy = (side == WHITE) ? BLACK : WHITE;
+    if (m.is_castle()) return true; // The castling generator checked its own squares
+    if (from == ksq) return !(attackers_to(to, occupied() ^ square_bb(ksq)) & side_bb[stm ^ 1]);
+    if (m.is_ep()) return ep_is_legal(from);
 
-    if (side == WHITE && from == sq(4, 0)) { // e1
-        // You cannot castle out of check
-        if (!is_in_check(WHITE)) {
-            // Kingside: e1 -> g1, rook h1 -> f1
-            if (castling_rights & 1) {
-                if (board[sq(7,0)] == WR && // rook present
-                    board[sq(5,0)] == EMPTY && // f1 empty
-                    board[sq(6,0)] == EMPTY && // g1 empty
-                    !is_square_attacked(sq(5,0), enemy) && // f1 not attacked
-                    !is_square_attacked(sq(6,0), enemy)) { // g1 not attacked
-                    add_move(list, from, sq(6,0), 0); // e1g1
-                }
-            }
-            // Queenside: e1 -> c1, rook a1 -> d1
-            if (castling_rights & 2) {
-                if (board[sq(0,0)] == WR && // rook present
-                    board[sq(3,0)] == EMPTY && // d1 empty
-                    board[sq(2,0)] == EMPTY && // c1 empty
-                    board[sq(1,0)] == EMPTY && // b1 empty
-                    !is_square_attacked(sq(3,0), enemy) && // d1 not attacked
-                    !is_square_attacked(sq(2,0), enemy)) { // c1 not attacked
-                    add_move(list, from, sq(2,0), 0); // e1c1
-                }
-            }
-        }
-    } else if (side == BLACK && from == sq(4, 7)) { // e8
-        if (!is_in_check(BLACK)) {
-            // Kingside: e8 -> g8, rook h8 -> f8
-            if (castling_rights & 4) {
-                if (board[sq(7,7)] == BR &&
-                    board[sq(5,7)] == EMPTY &&
-                    board[sq(6,7)] == EMPTY &&
-                    !is_square_attacked(sq(5,7), enemy) &&
-                    !is_square_attacked(sq(6,7), enemy)) {
-                    add_move(list, from, sq(6,7), 0); // e8g8
-                }
-            }
-            // Queenside: e8 -> c8, rook a8 -> d8
-            if (castling_rights & 8) {
-                if (board[sq(0,7)] == BR &&
-                    board[sq(3,7)] == EMPTY &&
-                    board[sq(2,7)] == EMPTY &&
-                    board[sq(1,7)] == EMPTY &&
-                    !is_square_attacked(sq(3,7), enemy) &&
-                    !is_square_attacked(sq(2,7), enemy)) {
-                    add_move(list, from, sq(2,7), 0); // e8c8
-                }
-            }
-        }
+    Bitboard checkers = attackers_to(ksq, occupied()) & side_bb[stm ^ 1];
+    if (checkers) {
+        if (checkers & (checkers - 1)) return false;
+        if (!((BETWEEN[ksq][lsb(checkers)] | checkers) & square_bb(to))) return false;
     }
+    return !(pinned_pieces(stm) & square_bb(from)) || (LINE[ksq][from] & square_bb(to));
 }
 
-void gen_moves(MoveList& list) {
-    list.count = 0;
-    for (int sq = 0; sq < 64; sq++) {
-        int p = board[sq];
-        if (p == EMPTY) continue;
-        // Piece must be the same color as the side to move to generate the move:
-        if (!same_side(p, side_to_move)) continue;
-        if (p == WN || p == BN) gen_knight_moves(sq, list); // Knight
-        else if (p == WP || p == BP) gen_pawn_moves(sq, list, side_to_move); // Pawn
-        else if (p == WB || p == BB) gen_bishop_moves(sq, list, side_to_move); // Bishop
-        else if (p == WR || p == BR) gen_rook_moves(sq, list, side_to_move); // Rook
-        else if (p == WQ || p == BQ) gen_queen_moves(sq, list, side_to_move); // Queen
-        else if (p == WK || p == BK) gen_king_moves(sq, list, side_to_move); // King
-        // TODO: Castling, en passant, legality check
-    }
-}
-
-void gen_legal_moves(MoveList& legal) {
+// The original make/test/unmake filter, kept as a cross-check for gen_legal_moves
+void Position::gen_legal_moves_filtered(MoveList& legal) {
     MoveList pseudo;
     gen_moves(pseudo);
     legal.count = 0;
-    int movingSide = side_to_move;
+    int movingSide = stm;
 
     for (int i = 0; i < pseudo.count; i++) {
         const Move& m = pseudo.moves[i];
@@ -525,7 +622,7 @@ int promo_char_to_piece(char c, int side) {
     }
 }
 
-bool parse_uci_move(const std::string& s, Move& out) {
+bool parse_uci_move(const Position& pos, const std::string& s, Move& out) {
     // Ex. input e2e4 or e7e8q (two squares back to back and optional promo square)
     if (s.size() != 4 && s.size() != 5) return false;
 
@@ -533,166 +630,174 @@ bool parse_uci_move(const std::string& s, Move& out) {
     int to = parse_square(s[2], s[3]);
     if (from < 0 || to < 0) return false; // Either parse_square is invalid
 
-    // Move struct declared in defs earlier - from, to, promo
-    out.from = static_cast<uint8_t>(from);
-    out.to = static_cast<uint8_t>(to);
-    out.promo = 0; // No promo unless...
-
     if (s.size() == 5) { // Size is 5 -> promo
-        int promoPiece = promo_char_to_piece(s[4], side_to_move);
+        int promoPiece = promo_char_to_piece(s[4], pos.side_to_move());
         if (promoPiece == 0) return false;
-        // Store promotion piece enum
-        out.promo = static_cast<uint8_t>(promoPiece);
+        out = Move::promotion(from, to, piece_type(promoPiece));
+        return true;
     }
+
+    // UCI doesn't mark castling or ep, the board tells us
+    int moved = piece_type(pos.piece_on(from));
+    int flag = MOVE_NORMAL;
+    if (moved == KING && (to - from == 2 || from - to == 2)) flag = MOVE_CASTLE;
+    else if (moved == PAWN && to == pos.ep() && file_of(from) != file_of(to)) flag = MOVE_EP;
+    out = Move(from, to, flag);
     return true;
 }
 
-// Updated make_move that uses Undo struct and pushes back onto history stack
-bool make_move(const Move& m) {
-    int from = m.from;
-    int to = m.to;
-    if (from < 0 || from >= 64 || to < 0 || to >= 64) return false; // Not a valid square
+std::string move_to_uci(const Move& m) {
+    std::string s;
+    s += (char)('a' + (m.from() & 7));
+    s += (char)('1' + (m.from() >> 3));
+    s += (char)('a' + (m.to() & 7));
+    s += (char)('1' + (m.to() >> 3));
+    // UCI always uses lowercase promotion letters
+    if (m.is_promo()) s += (char)(piece_to_char(make_piece(BLACK, m.promo_type())));
+    return s;
+}
+
+// Castling rights that survive a move touching each square: moving off or capturing on a
+// king or rook home square clears the matching KQkq bits
+static int CASTLING_MASK[64];
+
+static void init_castling_mask() {
+    for (int& m : CASTLING_MASK) m = 15;
+    CASTLING_MASK[sq(4,0)] &= ~(1 | 2); // e1
+    CASTLING_MASK[sq(7,0)] &= ~1;       // h1
+    CASTLING_MASK[sq(0,0)] &= ~2;       // a1
+    CASTLING_MASK[sq(4,7)] &= ~(4 | 8); // e8
+    CASTLING_MASK[sq(7,7)] &= ~4;       // h8
+    CASTLING_MASK[sq(0,7)] &= ~8;       // a8
+}
 
+// The move's flag says what kind it is, so nothing here re-derives castling or ep from the
+// board. Pushes a record onto the undo stack.
+bool Position::make_move(const Move& m) {
+    STATS_INC(makes);
+    int from = m.from();
+    int to = m.to();
     int piece = board[from];
     if (piece == EMPTY) return false; // Nothing to move
 
     Undo u;
-    u.from = (uint8_t)from; u.to = (uint8_t)to;
-    u.moved = piece;
-    u.captured = board[to];
-    u.promo = m.promo;
-    u.prev_side = side_to_move;
-    u.prev_castling = castling_rights;
-    u.prev_ep = ep_square;
-    u.was_ep = false;
-
-    // Handle castling case first - move just the rook first:
-    if (piece == WK && from == sq(4,0)) {
-        if (to == sq(6,0)) { // Kingside
-            board[sq(5,0)] = WR;
-            board[sq(7,0)] = EMPTY;
-        } else if (to == sq(2,0)) { // Queenside
-            board[sq(3,0)] = WR;
-            board[sq(0,0)] = EMPTY;
-        }
-    }
-    // For black
-    if (piece == BK && from == sq(4,7)) {
-        if (to == sq(6,7)) {
-            board[sq(5,7)] = BR;
-            board[sq(7,7)] = EMPTY;
-        } else if (to == sq(2,7)) {
-            board[sq(3,7)] = BR;
-            board[sq(0,7)] = EMPTY;
-        }
-    }
-
-    // Apply (Moves the king in the case of castling)
-    board[from] = EMPTY;
-    if (m.promo != 0) {
-        board[to] = (int)m.promo; // Not sure if int cast needed here, take look later
-    } else {
-        board[to] = piece;
-    }
-
-    side_to_move = (side_to_move == WHITE ? BLACK : WHITE);
+    u.prev_key = hash_key;
+    u.move = m;
+    u.moved = (uint8_t)piece;
+    u.captured = (uint8_t)board[to];
+    u.prev_castling = (uint8_t)castling_rights;
+    u.prev_ep = (int8_t)ep_square;
     history.push_back(u);
 
-    ep_square = -1; // Previous calls will have set this var, clear it:
-
-    if ((u.moved == WP || u.moved == BP) && u.captured == EMPTY && to == u.prev_ep && file_of(from) != file_of(to)){
-            // Clear the square below or above the square our pawn just moved to
-            int cap_sq = (u.moved == WP) ? to - 8 : to + 8;
-            board[cap_sq] = EMPTY;
-            history.back().was_ep = true;
+    // Take the old side/castling/ep terms out now, the new ones go back in at the end
+    hash_key ^= ZOBRIST_CASTLING[castling_rights];
+    if (ep_capturable()) hash_key ^= ZOBRIST_EP[ep_square & 7];
+
+    switch (m.flag()) {
+    case MOVE_CASTLE:
+        // Rook first: h-file to the f-file kingside, a-file to the d-file queenside
+        if (to > from) move_piece(from + 3, from + 1);
+        else move_piece(from - 4, from - 1);
+        move_piece(from, to);
+        break;
+    case MOVE_EP:
+        // set_fen only keeps an ep square with the double-pushed pawn in front of it
+        assert(board[stm == WHITE ? to - 8 : to + 8] == make_piece(stm ^ 1, PAWN));
+        remove_piece(stm == WHITE ? to - 8 : to + 8);
+        move_piece(from, to);
+        break;
+    case MOVE_NORMAL:
+        if (u.captured != EMPTY) remove_piece(to);
+        move_piece(from, to);
+        break;
+    default: // Promotions
+        if (u.captured != EMPTY) remove_piece(to);
+        remove_piece(from);
+        put_piece(make_piece(stm, m.promo_type()), to);
+        break;
     }
 
-    // Pawn double push allows en passant:
-    if (u.moved == WP && m.to - m.from == 16)
-        ep_square = m.from + 8;
-    else if (u.moved == BP && m.from - m.to == 16)
-        ep_square = m.from - 8;
+    // Pawn double push allows en passant
+    ep_square = -1;
+    if (piece_type(piece) == PAWN && (to - from == 16 || from - to == 16)) ep_square = (from + to) / 2;
 
-    // Update rights for castling if a king has moved
-    if (piece == WK) castling_rights &= ~(1 | 2);
-    if (piece == BK) castling_rights &= ~(4 | 8);
+    castling_rights &= CASTLING_MASK[from] & CASTLING_MASK[to];
+    stm ^= 1;
 
-    // Rook moved from its original square
-    if (piece == WR && from == sq(7,0)) castling_rights &= ~1; // h1
-    if (piece == WR && from == sq(0,0)) castling_rights &= ~2; // a1
-    if (piece == BR && from == sq(7,7)) castling_rights &= ~4; // h8
-    if (piece == BR && from == sq(0,7)) castling_rights &= ~8; // a8
+    hash_key ^= ZOBRIST_SIDE ^ ZOBRIST_CASTLING[castling_rights];
+    if (ep_capturable()) hash_key ^= ZOBRIST_EP[ep_square & 7];
 
-    // Captured rook on its original square
-    if (u.captured == WR && to == sq(7,0)) castling_rights &= ~1;
-    if (u.captured == WR && to == sq(0,0)) castling_rights &= ~2;
-    if (u.captured == BR && to == sq(7,7)) castling_rights &= ~4;
-    if (u.captured == BR && to == sq(0,7)) castling_rights &= ~8;
+    if (nnue) nnue->push(*this, history.back());
     return true;
 }
 
-// Undoes make_move from above by popping back of history vector:
-bool undo_move() {
+// Undoes make_move from above by popping the undo stack
+bool Position::undo_move() {
+    STATS_INC(undos);
     if (history.empty()) return false;
 
-    Undo u = history.back();
-    history.pop_back();
-
-    // Restore side + castling rights first
-    side_to_move = u.prev_side;
+    const Undo& u = history.back();
+    int from = u.move.from(), to = u.move.to();
+    stm ^= 1;
     castling_rights = u.prev_castling;
-
-    // Restore en passant state
     ep_square = u.prev_ep;
 
-    // If this move was castling, undo rook as well:
-    if ((u.moved == WK || u.moved == BK) && std::abs((int)u.to - (int)u.from) == 2) {
-        if (u.moved == WK) {
-            if (u.to == sq(6,0)) {          // e1g1
-                board[sq(7,0)] = WR;        // rook back to h1
-                board[sq(5,0)] = EMPTY;     // clear f1
-            } else {                         // e1c1
-                board[sq(0,0)] = WR;        // rook back to a1
-                board[sq(3,0)] = EMPTY;     // clear d1
-            }
-        } else { // BK
-            if (u.to == sq(6,7)) {          // e8g8
-                board[sq(7,7)] = BR;
-                board[sq(5,7)] = EMPTY;
-            } else {                         // e8c8
-                board[sq(0,7)] = BR;
-                board[sq(3,7)] = EMPTY;
-            }
-        }
+    switch (u.move.flag()) {
+    case MOVE_CASTLE:
+        move_piece(to, from);
+        if (to > from) move_piece(from + 1, from + 3);
+        else move_piece(from - 1, from - 4);
+        break;
+    case MOVE_EP:
+        move_piece(to, from);
+        put_piece(make_piece(stm ^ 1, PAWN), stm == WHITE ? to - 8 : to + 8);
+        break;
+    case MOVE_NORMAL:
+        move_piece(to, from);
+        if (u.captured != EMPTY) put_piece(u.captured, to);
+        break;
+    default: // Promotions
+        remove_piece(to);
+        put_piece(u.moved, from);
+        if (u.captured != EMPTY) put_piece(u.captured, to);
+        break;
     }
 
-    // Restore destination square
-    board[u.to] = u.captured;
-
-    // Restore source square (ep square has captured as empty)
-    if (u.promo != 0) {
-        board[u.from] = (side_to_move == WHITE) ? WP : BP;
-    } else {
-        board[u.from] = u.moved;
-    }
-
-    // Restore EP-captured pawn (third square)
-    if (u.was_ep) {
-        int cap_sq = (side_to_move == WHITE) ? (u.to - 8) : (u.to + 8);
-        board[cap_sq] = (side_to_move == WHITE) ? BP : WP;
-    }
+    // The piece helpers above touched the key too, but the saved one is exact
+    hash_key = u.prev_key;
+    history.pop_back();
 
+    if (nnue) nnue->pop();
     return true;
 }
 
-// Does nothing for now I forgot to say lmao
-void init() {}
+// Build the attack tables (magics are searched for here unless PEXT is available), Zobrist keys
+// and the evaluation tables, pick the NNUE kernels for this CPU and fill the book key table
+void init() {
+    init_bitboards();
+    init_zobrist();
+    init_castling_mask();
+    init_eval();
+    init_pawns();
+    init_nnue();
+}
+
+bool Position::is_sane() const {
+    // Pawns on the back ranks would walk the attack/push tables off the board
+    Bitboard backPawns = (pieces(WHITE, PAWN) | pieces(BLACK, PAWN)) & (RANK_1_BB | RANK_8_BB);
+    return popcount(pieces(WHITE, KING)) == 1 && popcount(pieces(BLACK, KING)) == 1 && !backPawns
+        && !is_in_check(side_to_move() ^ 1);
+}
 
 // This shouldn't be parsing any incomplete FEN (throws false if so?)
-bool set_fen(const char* fen) {
+bool Position::set_fen(const char* fen) {
 
     // Clear the board and history
     for (int i = 0; i < 64; ++i) board[i] = EMPTY;
+    for (Bitboard& b : piece_bb) b = 0;
+    side_bb[WHITE] = side_bb[BLACK] = 0;
+    king_sq[WHITE] = king_sq[BLACK] = -1;
+    mg_sum = eg_sum = game_phase = 0;
     clear_history();
     castling_rights = 0;
     ep_square = -1;
@@ -724,7 +829,7 @@ bool set_fen(const char* fen) {
         if (piece < 0) return false;
 
         if (file >= 8 || rank < 0) return false;
-        board[sq(file, rank)] = piece;
+        put_piece(piece, sq(file, rank));
         file++;
     }
 
@@ -738,8 +843,8 @@ bool set_fen(const char* fen) {
     p++; // Skip the space
 
     // Which side?
-    if (*p == 'w') side_to_move = WHITE;
-    else if (*p == 'b') side_to_move = BLACK;
+    if (*p == 'w') stm = WHITE;
+    else if (*p == 'b') stm = BLACK;
     else return false;
 
     p++;
@@ -771,11 +876,20 @@ bool set_fen(const char* fen) {
         if (parse_square(p[0], p[1]) < 0) return false;
         ep_square = parse_square(p[0], p[1]);
         p += 2;
+        // Only keep it if a pawn could really have just double-pushed past it, otherwise
+        // movegen would happily capture a pawn that isn't there
+        int up = stm == WHITE ? 8 : -8;
+        if ((ep_square >> 3) != (stm == WHITE ? 5 : 2) || board[ep_square] != EMPTY
+            || board[ep_square + up] != EMPTY || board[ep_square - up] != make_piece(stm ^ 1, PAWN))
+            ep_square = -1;
     }
+    hash_key = compute_key();
+    pawn_hash = compute_pawn_key();
+    if (nnue) nnue->reset(*this);
     return true;
 }
 
-void set_startpos() {
+void Position::set_startpos() {
     // Standard start position FEN
     const char* start = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
     (void)set_fen(start);
@@ -0,0 +1,199 @@
+#include "eval.h"
+#include "pawns.h"
+#include "stats.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+// Material per phase: pawn, knight, bishop, rook, queen, king
+static const int VALUE_MG[7] = { 0, 82, 337, 365, 477, 1025, 0 };
+static const int VALUE_EG[7] = { 0, 94, 281, 297, 512, 936, 0 };
+
+const int PHASE_WEIGHT[PIECE_NB] = { 0, 0, 1, 1, 2, 4, 0, 0, 0, 0, 1, 1, 2, 4, 0, 0 };
+
+// Piece-square tables from white's side, written as seen on the board: first row is rank 8
+static const int PAWN_MG[64] = {
+      0,   0,   0,   0,   0,   0,   0,   0,
+     50,  50,  50,  50,  50,  50,  50,  50,
+     10,  10,  20,  30,  30,  20,  10,  10,
+      5,   5,  10,  25,  25,  10,   5,   5,
+      0,   0,   0,  20,  20,   0,   0,   0,
+      5,  -5, -10,   0,   0, -10,  -5,   5,
+      5,  10,  10, -20, -20,  10,  10,   5,
+      0,   0,   0,   0,   0,   0,   0,   0,
+};
+static const int PAWN_EG[64] = {
+      0,   0,   0,   0,   0,   0,   0,   0,
+     80,  80,  80,  80,  80,  80,  80,  80,
+     50,  50,  50,  50,  50,  50,  50,  50,
+     30,  30,  30,  30,  30,  30,  30,  30,
+     20,  20,  20,  20,  20,  20,  20,  20,
+     10,  10,  10,  10,  10,  10,  10,  10,
+     10,  10,  10,  10,  10,  10,  10,  10,
+      0,   0,   0,   0,   0,   0,   0,   0,
+};
+static const int KNIGHT_PST[64] = {
+    -50, -40, -30, -30, -30, -30, -40, -50,
+    -40, -20,   0,   0,   0,   0, -20, -40,
+    -30,   0,  10,  15,  15,  10,   0, -30,
+    -30,   5,  15,  20,  20,  15,   5, -30,
+    -30,   0,  15,  20,  20,  15,   0, -30,
+    -30,   5,  10,  15,  15,  10,   5, -30,
+    -40, -20,   0,   5,   5,   0, -20, -40,
+    -50, -40, -30, -30, -30, -30, -40, -50,
+};
+static const int BISHOP_PST[64] = {
+    -20, -10, -10, -10, -10, -10, -10, -20,
+    -10,   0,   0,   0,   0,   0,   0, -10,
+    -10,   0,   5,  10,  10,   5,   0, -10,
+    -10,   5,   5,  10,  10,   5,   5, -10,
+    -10,   0,  10,  10,  10,  10,   0, -10,
+    -10,  10,  10,  10,  10,  10,  10, -10,
+    -10,   5,   0,   0,   0,   0,   5, -10,
+    -20, -10, -10, -10, -10, -10, -10, -20,
+};
+static const int ROOK_PST[64] = {
+      0,   0,   0,   0,   0,   0,   0,   0,
+      5,  10,  10,  10,  10,  10,  10,   5,
+     -5,   0,   0,   0,   0,   0,   0,  -5,
+     -5,   0,   0,   0,   0,   0,   0,  -5,
+     -5,   0,   0,   0,   0,   0,   0,  -5,
+     -5,   0,   0,   0,   0,   0,   0,  -5,
+     -5,   0,   0,   0,   0,   0,   0,  -5,
+      0,   0,   0,   5,   5,   0,   0,   0,
+};
+static const int QUEEN_PST[64] = {
+    -20, -10, -10,  -5,  -5, -10, -10, -20,
+    -10,   0,   0,   0,   0,   0,   0, -10,
+    -10,   0,   5,   5,   5,   5,   0, -10,
+     -5,   0,   5,   5,   5,   5,   0,  -5,
+      0,   0,   5,   5,   5,   5,   0,  -5,
+    -10,   5,   5,   5,   5,   5,   0, -10,
+    -10,   0,   5,   0,   0,   0,   0, -10,
+    -20, -10, -10,  -5,  -5, -10, -10, -20,
+};
+static const int KING_MG[64] = {
+    -30, -40, -40, -50, -50, -40, -40, -30,
+    -30, -40, -40, -50, -50, -40, -40, -30,
+    -30, -40, -40, -50, -50, -40, -40, -30,
+    -30, -40, -40, -50, -50, -40, -40, -30,
+    -20, -30, -30, -40, -40, -30, -30, -20,
+    -10, -20, -20, -20, -20, -20, -20, -10,
+     20,  20,   0,   0,   0,   0,  20,  20,
+     20,  30,  10,   0,   0,  10,  30,  20,
+};
+static const int KING_EG[64] = {
+    -50, -40, -30, -20, -20, -30, -40, -50,
+    -30, -20, -10,   0,   0, -10, -20, -30,
+    -30, -10,  20,  30,  30,  20, -10, -30,
+    -30, -10,  30,  40,  40,  30, -10, -30,
+    -30, -10,  30,  40,  40,  30, -10, -30,
+    -30, -10,  20,  30,  30,  20, -10, -30,
+    -30, -30,   0,   0,   0,   0, -30, -30,
+    -50, -30, -30, -30, -30, -30, -30, -50,
+};
+
+static const int* const TABLE_MG[7] = { nullptr, PAWN_MG, KNIGHT_PST, BISHOP_PST, ROOK_PST, QUEEN_PST, KING_MG };
+static const int* const TABLE_EG[7] = { nullptr, PAWN_EG, KNIGHT_PST, BISHOP_PST, ROOK_PST, QUEEN_PST, KING_EG };
+
+int PSQ_MG[PIECE_NB][64];
+int PSQ_EG[PIECE_NB][64];
+
+void init_eval() {
+    for (int t = PAWN; t <= KING; t++) {
+        for (int s = 0; s < 64; s++) {
+            // Tables are written rank 8 first; white on s reads row (7 - rank), black mirrors onto rank
+            int whiteIdx = (7 - (s >> 3)) * 8 + (s & 7);
+            int blackIdx = (s >> 3) * 8 + (s & 7);
+            PSQ_MG[make_piece(WHITE, t)][s] = VALUE_MG[t] + TABLE_MG[t][whiteIdx];
+            PSQ_EG[make_piece(WHITE, t)][s] = VALUE_EG[t] + TABLE_EG[t][whiteIdx];
+            PSQ_MG[make_piece(BLACK, t)][s] = -(VALUE_MG[t] + TABLE_MG[t][blackIdx]);
+            PSQ_EG[make_piece(BLACK, t)][s] = -(VALUE_EG[t] + TABLE_EG[t][blackIdx]);
+        }
+    }
+}
+
+// Blend middlegame and endgame by how much non-pawn material is left
+static int taper(int mg, int eg, int phase) {
+    phase = std::min(phase, MAX_PHASE);
+    return (mg * phase + eg * (MAX_PHASE - phase)) / MAX_PHASE;
+}
+
+// Cached structure plus the per-node parts (shelter for the current king squares, free passers)
+static void add_pawn_terms(const Position& pos, PawnEntry& e, int& mg, int& eg) {
+    mg += e.mg + king_shelter(pos, e, WHITE) - king_shelter(pos, e, BLACK);
+    eg += e.eg + free_passers(pos, e);
+}
+
+int evaluate(const Position& pos, PawnTable* pawns) {
+    STATS_TIME(eval_ns);
+    // Searchers attach accumulators only while a net is loaded; everything else stays classical
+    if (const NnueStack* acc = pos.nnue_stack(); acc && nnue_loaded())
+        return nnue_evaluate(pos, acc->current());
+
+    int mg = pos.psq_mg(), eg = pos.psq_eg();
+    PawnEntry scratch;
+    if (pawns) {
+        add_pawn_terms(pos, pawns->probe(pos), mg, eg);
+    } else {
+        evaluate_pawns(pos, scratch);
+        add_pawn_terms(pos, scratch, mg, eg);
+    }
+    int score = taper(mg, eg, pos.phase());
+    return pos.side_to_move() == WHITE ? score : -score;
+}
+
+void eval_trace(const Position& pos) {
+    int mat[2][2] = {}, pst[2][2] = {}; // [side][mg/eg]
+    int phase = 0;
+    for (int s = 0; s < 64; s++) {
+        int p = pos.piece_on(s);
+        if (p == EMPTY) continue;
+        int side = piece_side(p), t = piece_type(p);
+        int sign = side == WHITE ? 1 : -1;
+        mat[side][0] += VALUE_MG[t];
+        mat[side][1] += VALUE_EG[t];
+        pst[side][0] += sign * PSQ_MG[p][s] - VALUE_MG[t];
+        pst[side][1] += sign * PSQ_EG[p][s] - VALUE_EG[t];
+        phase += PHASE_WEIGHT[p];
+    }
+
+    int mg = mat[WHITE][0] + pst[WHITE][0] - mat[BLACK][0] - pst[BLACK][0];
+    int eg = mat[WHITE][1] + pst[WHITE][1] - mat[BLACK][1] - pst[BLACK][1];
+    char line[128];
+    std::cout << "      term |   white mg   white eg |   black mg   black eg\n";
+    std::snprintf(line, sizeof line, "  material | %10d %10d | %10d %10d\n", mat[WHITE][0], mat[WHITE][1], mat[BLACK][0], mat[BLACK][1]);
+    std::cout << line;
+    std::snprintf(line, sizeof line, "      psqt | %10d %10d | %10d %10d\n", pst[WHITE][0], pst[WHITE][1], pst[BLACK][0], pst[BLACK][1]);
+    std::cout << line;
+    bool ok = mg == pos.psq_mg() && eg == pos.psq_eg() && phase == pos.phase();
+
+    PawnEntry pawns;
+    evaluate_pawns(pos, pawns);
+    int shelter[2] = { king_shelter(pos, pawns, WHITE), king_shelter(pos, pawns, BLACK) };
+    std::snprintf(line, sizeof line, "   shelter | %10d %10s | %10d %10s\n", shelter[WHITE], "", shelter[BLACK], "");
+    std::cout << line;
+    std::cout << "pawn structure mg " << pawns.mg << " eg " << pawns.eg << " (white)\n";
+    std::cout << "free passers eg " << free_passers(pos, pawns) << " (white)\n";
+    for (int side : { WHITE, BLACK }) {
+        std::cout << (side == WHITE ? "passed white:" : " | black:");
+        Bitboard b = pawns.passed & pos.pieces(side, PAWN);
+        if (!b) std::cout << " none";
+        while (b) {
+            int s = pop_lsb(b);
+            std::cout << ' ' << (char)('a' + (s & 7)) << (char)('1' + (s >> 3));
+        }
+    }
+    std::cout << "\n";
+    add_pawn_terms(pos, pawns, mg, eg);
+
+    std::cout << "total mg " << mg << " eg " << eg << " phase " << std::min(phase, MAX_PHASE) << "/" << MAX_PHASE
+              << "\nscore " << taper(mg, eg, phase) << " (white), " << evaluate(pos) << " (side to move)\n";
+    std::cout << "incremental " << (ok ? "ok" : "MISMATCH") << (pos.pawn_key() == pos.compute_pawn_key() ? "" : " (pawn key MISMATCH)") << "\n";
+    if (nnue_loaded())
+        std::cout << "nnue " << nnue_evaluate_full(pos) << " (side to move, " << nnue_kernel_name() << " kernels)\n";
+    else
+        std::cout << "nnue off (no EvalFile loaded)\n";
+    std::cout << std::flush;
+}
@@ -1,8 +1,21 @@
 #include "defs.h"
+#include "batch.h"
+#include "tt.h"
 
-int main() {
+#include <sstream>
+#include <string>
+
+int main(int argc, char** argv) {
     init();
-    set_startpos();
+    // "chessbot batch ..." runs one batch job and exits instead of talking UCI
+    if (argc > 1 && std::string(argv[1]) == "batch") {
+        std::string line;
+        for (int i = 2; i < argc; i++) line += std::string(argv[i]) + ' ';
+        std::istringstream args(line);
+        TT.resize(16, 1); // Same default as the Hash option, "hash MB" overrides it
+
+        return batch_command(args) ? 0 : 1;
+    }
     uci_loop();
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,137 @@
+#include "movepick.h"
+
+#include <cstdlib>
+
+// Gravity: the closer an entry already is to the limit, the less a bonus moves it
+void update_history(int& entry, int bonus) {
+    entry += bonus - entry * std::abs(bonus) / HISTORY_MAX;
+}
+
+MovePicker::MovePicker(Position& p, const Move& hashMove, const Move* k, const ButterflyHistory& h)
+    : pos(p), hash_move(hashMove), history(&h) {
+    killers[0] = k ? k[0] : Move{};
+    killers[1] = k ? k[1] : Move{};
+    if (hash_move.is_none() || !pos.is_pseudo_legal(hash_move) || !pos.is_legal(hash_move))
+        hash_move = Move{};
+}
+
+MovePicker::MovePicker(Position& p) : pos(p), stage(QS_TACTICAL_INIT) {}
+
+// Killers are quiet moves from a sibling node, so they may not even be possible here
+bool MovePicker::usable_killer(const Move& m) const {
+    return !m.is_none() && m != hash_move && !pos.is_capture(m) && !m.is_promo() &&
+           pos.is_pseudo_legal(m) && pos.is_legal(m);
+}
+
+// MVV-LVA: biggest victim first, cheapest attacker among equals; promotions by the new piece
+void MovePicker::score_tactical() {
+    for (int i = 0; i < list.count; i++) {
+        const Move& m = list.moves[i];
+        int victim = pos.piece_on(m.to()) != EMPTY ? piece_type(pos.piece_on(m.to()))
+                   : m.is_ep()                     ? PAWN
+                                                   : NO_TYPE;
+        scores[i] = victim * 8 - piece_type(pos.piece_on(m.from())) + m.promo_type() * 8;
+    }
+    cur = 0;
+}
+
+bool MovePicker::pick_best(Move& out) {
+    while (cur < list.count) {
+        int best = cur;
+        for (int i = cur + 1; i < list.count; i++)
+            if (scores[i] > scores[best]) best = i;
+        std::swap(list.moves[cur], list.moves[best]);
+        std::swap(scores[cur], scores[best]);
+        out = list.moves[cur++];
+        // Already handed out by an earlier stage
+        if (out == hash_move || (stage == QUIETS && (out == killers[0] || out == killers[1]))) continue;
+        return true;
+    }
+    return false;
+}
+
+// SEE only runs on the moves actually reached, so a cutoff on the first capture pays for one
+bool MovePicker::pick_good_tactical(Move& out) {
+    while (pick_best(out)) {
+        if (pos.see(out) >= 0) return true;
+        bad.moves[bad.count++] = out;
+    }
+    return false;
+}
+
+bool MovePicker::next(Move& out) {
+    switch (stage) {
+    case HASH:
+        stage = TACTICAL_INIT;
+        if (!hash_move.is_none()) {
+            out = hash_move;
+            return true;
+        }
+        [[fallthrough]];
+
+    case TACTICAL_INIT:
+        pos.gen_legal_moves(list, GEN_TACTICAL);
+        score_tactical();
+        stage = TACTICAL;
+        [[fallthrough]];
+
+    case TACTICAL:
+        if (pick_good_tactical(out)) return true;
+        stage = KILLER1;
+        if (usable_killer(killers[0])) {
+            out = killers[0];
+            return true;
+        }
+        killers[0] = Move{};
+        [[fallthrough]];
+
+    case KILLER1:
+        stage = KILLER2;
+        if (killers[1] != killers[0] && usable_killer(killers[1])) {
+            out = killers[1];
+            return true;
+        }
+        killers[1] = Move{};
+        [[fallthrough]];
+
+    case KILLER2:
+    case QUIET_INIT: {
+        pos.gen_legal_moves(list, GEN_QUIETS);
+        const int (*h)[64] = (*history)[pos.side_to_move()];
+        for (int i = 0; i < list.count; i++) scores[i] = h[list.moves[i].from()][list.moves[i].to()];
+        cur = 0;
+        stage = QUIETS;
+        [[fallthrough]];
+    }
+
+    case QUIETS:
+        if (pick_best(out)) return true;
+        stage = BAD_TACTICAL;
+        cur = 0;
+        [[fallthrough]];
+
+    case BAD_TACTICAL:
+        // Already in MVV-LVA order from when they were set aside
+        if (cur < bad.count) {
+            out = bad.moves[cur++];
+            return true;
+        }
+        stage = DONE;
+        return false;
+
+    case QS_TACTICAL_INIT:
+        pos.gen_legal_moves(list, GEN_TACTICAL);
+        score_tactical();
+        stage = QS_TACTICAL;
+        [[fallthrough]];
+
+    case QS_TACTICAL:
+        // Losing captures are pruned here: they can't raise a stand-pat score
+        if (pick_good_tactical(out)) return true;
+        stage = DONE;
+        [[fallthrough]];
+
+    default:
+        return false;
+    }
+}
@@ -0,0 +1,310 @@
+#include "nnue.h"
+#include "position.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CHESSBOT_X86 1
+#include <immintrin.h>
+#else
+#define CHESSBOT_X86 0
+#endif
+
+struct Network {
+    std::vector<int16_t> ft_bias;
+    std::vector<int16_t> ft_weights; // [feature][hidden], so a feature's column is contiguous
+    std::vector<int16_t> out_weights; // [0, hidden) side to move, [hidden, 2 * hidden) the other side
+    int32_t out_bias = 0;
+    int32_t out_scale = 1;
+};
+
+static Network net;
+static bool net_loaded = false;
+
+// dst = src + sum(add columns) - sum(sub columns), NNUE_HIDDEN lanes
+using UpdateFn = void (*)(int16_t* dst, const int16_t* src, const int16_t* const* add, int nAdd,
+                          const int16_t* const* sub, int nSub);
+// Clipped ReLU of both halves dotted with the output weights
+using OutputFn = int32_t (*)(const int16_t* us, const int16_t* them, const int16_t* w);
+
+static void update_scalar(int16_t* dst, const int16_t* src, const int16_t* const* add, int nAdd,
+                          const int16_t* const* sub, int nSub) {
+    for (int i = 0; i < NNUE_HIDDEN; i++) {
+        int v = src[i];
+        for (int a = 0; a < nAdd; a++) v += add[a][i];
+        for (int s = 0; s < nSub; s++) v -= sub[s][i];
+        dst[i] = (int16_t)v;
+    }
+}
+
+static int32_t output_scalar(const int16_t* us, const int16_t* them, const int16_t* w) {
+    int32_t sum = 0;
+    for (int i = 0; i < NNUE_HIDDEN; i++) {
+        int a = us[i] < 0 ? 0 : (us[i] > 127 ? 127 : us[i]);
+        int b = them[i] < 0 ? 0 : (them[i] > 127 ? 127 : them[i]);
+        sum += a * w[i] + b * w[NNUE_HIDDEN + i];
+    }
+    return sum;
+}
+
+#if CHESSBOT_X86
+// SSE2 is part of x86-64 itself, so this needs no runtime check
+static void update_sse2(int16_t* dst, const int16_t* src, const int16_t* const* add, int nAdd,
+                        const int16_t* const* sub, int nSub) {
+    for (int i = 0; i < NNUE_HIDDEN; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        for (int a = 0; a < nAdd; a++) v = _mm_add_epi16(v, _mm_loadu_si128((const __m128i*)(add[a] + i)));
+        for (int s = 0; s < nSub; s++) v = _mm_sub_epi16(v, _mm_loadu_si128((const __m128i*)(sub[s] + i)));
+        _mm_storeu_si128((__m128i*)(dst + i), v);
+    }
+}
+
+static int32_t output_sse2(const int16_t* us, const int16_t* them, const int16_t* w) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i top = _mm_set1_epi16(127);
+    __m128i acc = _mm_setzero_si128();
+    for (int i = 0; i < NNUE_HIDDEN; i += 8) {
+        __m128i a = _mm_min_epi16(_mm_max_epi16(_mm_loadu_si128((const __m128i*)(us + i)), zero), top);
+        __m128i b = _mm_min_epi16(_mm_max_epi16(_mm_loadu_si128((const __m128i*)(them + i)), zero), top);
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(a, _mm_loadu_si128((const __m128i*)(w + i))));
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(b, _mm_loadu_si128((const __m128i*)(w + NNUE_HIDDEN + i))));
+    }
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, 0x4E));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, 0xB1));
+    return _mm_cvtsi128_si32(acc);
+}
+
+// Compiled for AVX2 here only, and only called once the CPU has said it supports it
+__attribute__((target("avx2")))
+static void update_avx2(int16_t* dst, const int16_t* src, const int16_t* const* add, int nAdd,
+                        const int16_t* const* sub, int nSub) {
+    for (int i = 0; i < NNUE_HIDDEN; i += 16) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+        for (int a = 0; a < nAdd; a++) v = _mm256_add_epi16(v, _mm256_loadu_si256((const __m256i*)(add[a] + i)));
+        for (int s = 0; s < nSub; s++) v = _mm256_sub_epi16(v, _mm256_loadu_si256((const __m256i*)(sub[s] + i)));
+        _mm256_storeu_si256((__m256i*)(dst + i), v);
+    }
+}
+
+__attribute__((target("avx2")))
+static int32_t output_avx2(const int16_t* us, const int16_t* them, const int16_t* w) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i top = _mm256_set1_epi16(127);
+    __m256i acc = _mm256_setzero_si256();
+    for (int i = 0; i < NNUE_HIDDEN; i += 16) {
+        __m256i a = _mm256_min_epi16(_mm256_max_epi16(_mm256_loadu_si256((const __m256i*)(us + i)), zero), top);
+        __m256i b = _mm256_min_epi16(_mm256_max_epi16(_mm256_loadu_si256((const __m256i*)(them + i)), zero), top);
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(a, _mm256_loadu_si256((const __m256i*)(w + i))));
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(b, _mm256_loadu_si256((const __m256i*)(w + NNUE_HIDDEN + i))));
+    }
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4E));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xB1));
+    return _mm_cvtsi128_si32(s);
+}
+#endif
+
+static UpdateFn update_fn = update_scalar;
+static OutputFn output_fn = output_scalar;
+static const char* kernel_name = "scalar";
+
+void init_nnue() {
+    // CHESSBOT_NNUE_KERNEL=scalar|sse2 caps the choice below (comparison runs)
+    const char* cap = std::getenv("CHESSBOT_NNUE_KERNEL");
+    std::string want = cap ? cap : "";
+    if (want == "scalar") return;
+#if CHESSBOT_X86
+    update_fn = update_sse2;
+    output_fn = output_sse2;
+    kernel_name = "sse2";
+    if (want == "sse2") return;
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        update_fn = update_avx2;
+        output_fn = output_avx2;
+        kernel_name = "avx2";
+    }
+#endif
+#endif
+}
+
+const char* nnue_kernel_name() { return kernel_name; }
+bool nnue_loaded() { return net_loaded; }
+
+void nnue_unload() {
+    net = Network();
+    net_loaded = false;
+}
+
+// Feature column for piece p on s, seen from persp with its king on ksq. Black's view is
+// flipped vertically and has the colours swapped, so one set of weights serves both sides.
+static const int16_t* column(int persp, int ksq, int p, int s) {
+    int flip = persp == WHITE ? 0 : 56;
+    int kind = (piece_type(p) - 1) * 2 + (piece_side(p) != persp);
+    int idx = (ksq ^ flip) * 640 + kind * 64 + (s ^ flip);
+    return &net.ft_weights[(size_t)idx * NNUE_HIDDEN];
+}
+
+static void refresh(int16_t* dst, const Position& pos, int persp) {
+    const int16_t* cols[16];
+    const int16_t* src = net.ft_bias.data();
+    int n = 0;
+    int ksq = pos.king_square(persp);
+    Bitboard b = pos.occupied() & ~pos.pieces(WHITE, KING) & ~pos.pieces(BLACK, KING);
+    while (b) {
+        int s = pop_lsb(b);
+        cols[n++] = column(persp, ksq, pos.piece_on(s), s);
+        // Flush in batches so any number of pieces fits the fixed list
+        if (n == 16) {
+            update_fn(dst, src, cols, n, nullptr, 0);
+            src = dst;
+            n = 0;
+        }
+    }
+    update_fn(dst, src, cols, n, nullptr, 0);
+}
+
+NnueStack::NnueStack() : stack(256) {}
+
+void NnueStack::reset(const Position& pos) {
+    top = 0;
+    if (!net_loaded) return;
+    refresh(stack[0].v[WHITE], pos, WHITE);
+    refresh(stack[0].v[BLACK], pos, BLACK);
+}
+
+void NnueStack::push(const Position& pos, const Undo& u) {
+    if (top + 1 == (int)stack.size()) stack.emplace_back();
+    top++;
+    if (!net_loaded) return;
+    const Accumulator& parent = stack[top - 1];
+    Accumulator& child = stack[top];
+
+    const Move& m = u.move;
+    int from = m.from(), to = m.to();
+    int us = piece_side(u.moved);
+    bool kingMove = piece_type(u.moved) == KING;
+
+    for (int persp = WHITE; persp <= BLACK; persp++) {
+        // Every feature of this side depends on its king square: start over
+        if (kingMove && persp == us) {
+            refresh(child.v[persp], pos, persp);
+            continue;
+        }
+        int ksq = pos.king_square(persp);
+        const int16_t* add[2];
+        const int16_t* sub[3];
+        int nAdd = 0, nSub = 0;
+
+        if (kingMove) {
+            // The king isn't a feature, only a castling rook hop changes anything
+            if (m.is_castle()) {
+                int rookFrom = to > from ? from + 3 : from - 4;
+                int rookTo = to > from ? from + 1 : from - 1;
+                int rook = make_piece(us, ROOK);
+                sub[nSub++] = column(persp, ksq, rook, rookFrom);
+                add[nAdd++] = column(persp, ksq, rook, rookTo);
+            }
+        } else {
+            sub[nSub++] = column(persp, ksq, u.moved, from);
+            add[nAdd++] = column(persp, ksq, m.is_promo() ? make_piece(us, m.promo_type()) : u.moved, to);
+        }
+        if (u.captured != EMPTY) sub[nSub++] = column(persp, ksq, u.captured, to);
+        if (m.is_ep()) {
+            int capSq = us == WHITE ? to - 8 : to + 8;
+            sub[nSub++] = column(persp, ksq, make_piece(us ^ 1, PAWN), capSq);
+        }
+        update_fn(child.v[persp], parent.v[persp], add, nAdd, sub, nSub);
+    }
+}
+
+int nnue_evaluate(const Position& pos, const Accumulator& acc) {
+    int stm = pos.side_to_move();
+    int32_t sum = output_fn(acc.v[stm], acc.v[stm ^ 1], net.out_weights.data()) + net.out_bias;
+    // Keep a badly scaled net from producing scores the search would read as mates
+    return std::clamp((int)(sum / net.out_scale), -20000, 20000);
+}
+
+int nnue_evaluate_full(const Position& pos) {
+    Accumulator acc;
+    refresh(acc.v[WHITE], pos, WHITE);
+    refresh(acc.v[BLACK], pos, BLACK);
+    return nnue_evaluate(pos, acc);
+}
+
+static uint64_t verify_walk(Position& pos, int depth) {
+    Accumulator full;
+    refresh(full.v[WHITE], pos, WHITE);
+    refresh(full.v[BLACK], pos, BLACK);
+    uint64_t bad = std::memcmp(&full, &pos.nnue_stack()->current(), sizeof full) != 0;
+    if (depth == 0) return bad;
+
+    MoveList moves;
+    pos.gen_legal_moves(moves);
+    for (int i = 0; i < moves.count; i++) {
+        pos.make_move(moves.moves[i]);
+        bad += verify_walk(pos, depth - 1);
+        pos.undo_move();
+    }
+    return bad;
+}
+
+uint64_t verify_nnue(const Position& root, int depth) {
+    if (!net_loaded) return 0;
+    Position pos = root;
+    NnueStack stack;
+    stack.reset(pos);
+    pos.attach_nnue(&stack);
+    return verify_walk(pos, depth);
+}
+
+template <typename T>
+static bool read_array(std::ifstream& in, std::vector<T>& v, size_t n) {
+    v.resize(n);
+    in.read(reinterpret_cast<char*>(v.data()), (std::streamsize)(n * sizeof(T)));
+    return (bool)in;
+}
+
+template <typename T>
+static bool read_value(std::ifstream& in, T& v) {
+    in.read(reinterpret_cast<char*>(&v), sizeof(T));
+    return (bool)in;
+}
+
+bool nnue_load(const std::string& path, std::string& error) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        error = "cannot open " + path;
+        return false;
+    }
+
+    char magic[4];
+    uint32_t version = 0, inputs = 0, hidden = 0;
+    in.read(magic, 4);
+    if (!in || std::memcmp(magic, "CBNN", 4) != 0) {
+        error = "not a ChessBot network file";
+        return false;
+    }
+    if (!read_value(in, version) || !read_value(in, inputs) || !read_value(in, hidden) ||
+        version != 1 || inputs != (uint32_t)NNUE_INPUTS || hidden != (uint32_t)NNUE_HIDDEN) {
+        error = "unsupported network version or shape";
+        return false;
+    }
+
+    Network n;
+    if (!read_array(in, n.ft_bias, NNUE_HIDDEN) ||
+        !read_array(in, n.ft_weights, (size_t)NNUE_INPUTS * NNUE_HIDDEN) ||
+        !read_array(in, n.out_weights, 2 * NNUE_HIDDEN) ||
+        !read_value(in, n.out_bias) || !read_value(in, n.out_scale) || n.out_scale <= 0) {
+        error = "truncated or corrupt network file";
+        return false;
+    }
+
+    net = std::move(n);
+    net_loaded = true;
+    return true;
+}
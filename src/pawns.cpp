@@ -0,0 +1,145 @@
+#include "pawns.h"
+#include "stats.h"
+
+#include <algorithm>
+
+// Squares ahead of s on its own file, and that plus both neighbouring files (no enemy
+// pawn in the latter means passed), per side
+static Bitboard FORWARD_FILE[2][64];
+static Bitboard PASSED_MASK[2][64];
+static Bitboard ADJACENT_FILES[8];
+
+// By relative rank (0 = own back rank)
+static const int PASSED_MG[8] = { 0, 5, 10, 15, 25, 40, 70, 0 };
+static const int PASSED_EG[8] = { 0, 10, 20, 35, 60, 100, 150, 0 };
+static const int DOUBLED_MG = -10, DOUBLED_EG = -20;
+static const int ISOLATED_MG = -10, ISOLATED_EG = -15;
+static const int BACKWARD_MG = -8, BACKWARD_EG = -10;
+// Own pawn in front of the king one or two ranks up, or none at all on that file
+static const int SHELTER_NEAR = 12, SHELTER_FAR = 6, SHELTER_OPEN = -15;
+
+void init_pawns() {
+    for (int f = 0; f < 8; f++)
+        ADJACENT_FILES[f] = (f > 0 ? FILE_A_BB << (f - 1) : 0) | (f < 7 ? FILE_A_BB << (f + 1) : 0);
+
+    for (int s = 0; s < 64; s++) {
+        int r = s >> 3;
+        Bitboard files = (FILE_A_BB << (s & 7)) | ADJACENT_FILES[s & 7];
+        Bitboard north = r < 7 ? ~0ULL << (8 * (r + 1)) : 0;
+        Bitboard south = r > 0 ? ~0ULL >> (8 * (8 - r)) : 0;
+        FORWARD_FILE[WHITE][s] = north & (FILE_A_BB << (s & 7));
+        FORWARD_FILE[BLACK][s] = south & (FILE_A_BB << (s & 7));
+        PASSED_MASK[WHITE][s] = north & files;
+        PASSED_MASK[BLACK][s] = south & files;
+    }
+}
+
+// Ranks at or behind rank r (absolute 0..7) as seen from side
+static Bitboard ranks_behind(int side, int r) {
+    return side == WHITE ? ~0ULL >> (8 * (7 - r)) : ~0ULL << (8 * r);
+}
+
+void evaluate_pawns(const Position& pos, PawnEntry& e) {
+    e.key = pos.pawn_key();
+    e.passed = 0;
+    e.king_sq[WHITE] = e.king_sq[BLACK] = 64;
+    int mg = 0, eg = 0;
+
+    for (int side = WHITE; side <= BLACK; side++) {
+        int sign = side == WHITE ? 1 : -1;
+        Bitboard us = pos.pieces(side, PAWN);
+        Bitboard them = pos.pieces(side ^ 1, PAWN);
+        Bitboard b = us;
+        while (b) {
+            int s = pop_lsb(b);
+            int f = s & 7, r = s >> 3;
+            int relRank = side == WHITE ? r : 7 - r;
+            Bitboard adj = ADJACENT_FILES[f];
+            int m = 0, n = 0;
+
+            if (us & FORWARD_FILE[side][s]) { // The rear pawn of a doubled pair
+                m += DOUBLED_MG;
+                n += DOUBLED_EG;
+            }
+            if (!(us & adj)) {
+                m += ISOLATED_MG;
+                n += ISOLATED_EG;
+            } else if (!(us & adj & ranks_behind(side, r))) {
+                // No neighbour can come up to support it, and advancing walks into a pawn capture
+                // is_sane keeps pawns off the back ranks, but never index past the board
+                int stop = side == WHITE ? s + 8 : s - 8;
+                if (stop >= 0 && stop < 64 && (PAWN_ATTACKS[side][stop] & them)) {
+                    m += BACKWARD_MG;
+                    n += BACKWARD_EG;
+                }
+            }
+            if (!(them & PASSED_MASK[side][s]) && !(us & FORWARD_FILE[side][s])) {
+                e.passed |= square_bb(s);
+                m += PASSED_MG[relRank];
+                n += PASSED_EG[relRank];
+            }
+            mg += sign * m;
+            eg += sign * n;
+        }
+    }
+    e.mg = (int16_t)mg;
+    e.eg = (int16_t)eg;
+}
+
+// Endgame bonus for passers whose next square is free; depends on the pieces, so per node
+int free_passers(const Position& pos, const PawnEntry& e) {
+    int eg = 0;
+    Bitboard b = e.passed;
+    while (b) {
+        int s = pop_lsb(b);
+        int side = piece_side(pos.piece_on(s));
+        int stop = side == WHITE ? s + 8 : s - 8;
+        if (stop < 0 || stop > 63 || pos.piece_on(stop) != EMPTY) continue;
+        int relRank = side == WHITE ? s >> 3 : 7 - (s >> 3);
+        eg += (side == WHITE ? 1 : -1) * PASSED_EG[relRank] / 2;
+    }
+    return eg;
+}
+
+int king_shelter(const Position& pos, PawnEntry& e, int side) {
+    int ksq = pos.king_square(side);
+    if (ksq < 0) return 0;
+    if (e.king_sq[side] == ksq) return e.shelter[side];
+
+    int score = 0;
+    int relRank = side == WHITE ? ksq >> 3 : 7 - (ksq >> 3);
+    // Only a king still on its first two ranks has a shelter worth talking about
+    if (relRank <= 1) {
+        Bitboard us = pos.pieces(side, PAWN);
+        int kf = ksq & 7;
+        int up = side == WHITE ? 8 : -8;
+        for (int f = (kf > 0 ? kf - 1 : 0); f <= (kf < 7 ? kf + 1 : 7); f++) {
+            int s = (ksq & ~7) + f;
+            if (us & square_bb(s + up)) score += SHELTER_NEAR;
+            else if (us & square_bb(s + 2 * up)) score += SHELTER_FAR;
+            else if (!(us & FORWARD_FILE[side][s])) score += SHELTER_OPEN;
+        }
+    }
+    e.king_sq[side] = (uint8_t)ksq;
+    e.shelter[side] = (int16_t)score;
+    return score;
+}
+
+PawnTable::PawnTable() : entries(new PawnEntry[PAWN_TABLE_ENTRIES]) {}
+
+void PawnTable::clear() {
+    std::fill(entries.get(), entries.get() + PAWN_TABLE_ENTRIES, PawnEntry{});
+}
+
+PawnEntry& PawnTable::probe(const Position& pos) {
+    uint64_t key = pos.pawn_key();
+    PawnEntry& e = entries[key & (PAWN_TABLE_ENTRIES - 1)];
+    STATS_INC(pawn_probes);
+    // A fresh slot has key 0 and zero scores, which is exactly the entry for "no pawns"
+    if (e.key == key) {
+        STATS_INC(pawn_hits);
+        return e;
+    }
+    evaluate_pawns(pos, e);
+    return e;
+}
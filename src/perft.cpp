@@ -1,19 +1,554 @@
-#include "defs.h"
+#include "perft.h"
+#include "search.h"
+#include <chrono>
 #include <cstdint>
 #include <cstdio>
+#include <algorithm>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+void PerftTable::resize(size_t mb) {
+    size_t want = (mb << 20) / sizeof(Bucket);
+    // Round down to a power of two so the index is just a mask
+    size_t n = 1;
+    while (n * 2 <= want) n *= 2;
+    if (n != buckets) {
+        table.reset(new Bucket[n]);
+        buckets = n;
+    }
+    clear();
+}
+
+void PerftTable::clear() {
+    for (size_t i = 0; i < buckets; i++) {
+        for (Entry& e : table[i].e) {
+            e.check.store(0, std::memory_order_relaxed);
+            e.data.store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+bool PerftTable::probe(uint64_t key, int depth, uint64_t& nodes) const {
+    const Bucket& b = table[key & (buckets - 1)];
+    for (const Entry& e : b.e) {
+        uint64_t data = e.data.load(std::memory_order_relaxed);
+        if ((int)(data & 0xFF) != depth) continue;
+        if ((e.check.load(std::memory_order_relaxed) ^ data) != key) continue;
+        nodes = data >> 8;
+        return true;
+    }
+    return false;
+}
+
+void PerftTable::store(uint64_t key, int depth, uint64_t nodes) {
+    Bucket& b = table[key & (buckets - 1)];
+    uint64_t data = (nodes << 8) | (uint64_t)depth;
+
+    // Replace the shallowest entry in the bucket: deep subtrees are the expensive ones to redo
+    Entry* victim = &b.e[0];
+    int victimDepth = 256;
+    for (Entry& e : b.e) {
+        int d = (int)(e.data.load(std::memory_order_relaxed) & 0xFF);
+        if (d < victimDepth) {
+            victim = &e;
+            victimDepth = d;
+        }
+    }
+    victim->check.store(key ^ data, std::memory_order_relaxed);
+    victim->data.store(data, std::memory_order_relaxed);
+}
 
 // Count the number of nodes at a certain depth to make sure movegen is working in full
-uint64_t perft(int depth) {
+uint64_t perft(Position& pos, int depth) {
     if (depth == 0) return 1;
+    // Too rare up here to cost anything; the count is meaningless after a stop anyway
+    if (depth >= 3 && Signals.stop.load(std::memory_order_relaxed)) return 0;
 
     MoveList moves;
-    gen_legal_moves(moves);
+    pos.gen_legal_moves(moves);
+    // Bulk count: the list is already legal, so the last ply needs no make/undo
+    if (depth == 1) return (uint64_t)moves.count;
 
     uint64_t nodes = 0;
     for (int i = 0; i < moves.count; i++) {
-        make_move(moves.moves[i]);
-        nodes += perft(depth - 1);
-        undo_move();
+        pos.make_move(moves.moves[i]);
+        nodes += perft(pos, depth - 1);
+        pos.undo_move();
     }
     return nodes;
-}
\ No newline at end of file
+}
+
+// Same count as perft(), but transpositions are only expanded once
+uint64_t perft_hashed(Position& pos, int depth, PerftTable& tt, PerftStats& stats) {
+    if (depth == 0) return 1;
+    if (depth >= 3 && Signals.stop.load(std::memory_order_relaxed)) return 0;
+
+    uint64_t nodes = 0;
+    // Depth 1 is cheaper to regenerate than to look up
+    if (depth > 1) {
+        stats.probes++;
+        if (tt.probe(pos.key(), depth, nodes)) {
+            stats.hits++;
+            return nodes;
+        }
+    }
+
+    MoveList moves;
+    pos.gen_legal_moves(moves);
+    if (depth == 1) return (uint64_t)moves.count;
+
+    for (int i = 0; i < moves.count; i++) {
+        pos.make_move(moves.moves[i]);
+        nodes += perft_hashed(pos, depth - 1, tt, stats);
+        pos.undo_move();
+    }
+
+    // A stopped count is short, keep it out of the table
+    if (depth > 1 && !Signals.stop.load(std::memory_order_relaxed)) tt.store(pos.key(), depth, nodes);
+    return nodes;
+}
+
+// A subtree to count: the moves leading to it from the root, and the depth left below it
+struct PerftTask {
+    static constexpr int MAX_PATH = 16;
+    Move path[MAX_PATH];
+    int len = 0;
+    int depth = 0;
+};
+
+struct PerftWorker {
+    std::mutex lock;
+    std::deque<PerftTask> tasks; // Owner works from the back, thieves take from the front
+    PerftStats stats;
+    uint64_t nodes = 0;
+};
+
+struct PerftPool {
+    std::vector<PerftWorker> workers;
+    std::atomic<int> pending{0}; // Tasks pushed but not finished yet; 0 means the whole tree is done
+    PerftTable* tt = nullptr;
+
+    explicit PerftPool(int n) : workers(n) {}
+
+    void push(int w, const PerftTask& t) {
+        pending.fetch_add(1, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> g(workers[w].lock);
+        workers[w].tasks.push_back(t);
+    }
+
+    bool pop(int w, PerftTask& t) {
+        PerftWorker& me = workers[w];
+        {
+            std::lock_guard<std::mutex> g(me.lock);
+            if (!me.tasks.empty()) {
+                t = me.tasks.back();
+                me.tasks.pop_back();
+                return true;
+            }
+        }
+        // Nothing local: steal the oldest (shallowest, so biggest) task from someone else
+        int n = (int)workers.size();
+        for (int i = 1; i < n; i++) {
+            PerftWorker& victim = workers[(w + i) % n];
+            std::lock_guard<std::mutex> g(victim.lock);
+            if (!victim.tasks.empty()) {
+                t = victim.tasks.front();
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+static void perft_worker(PerftPool& pool, int w, Position pos) {
+    PerftWorker& me = pool.workers[w];
+    const int splitBelow = (int)pool.workers.size() * 4;
+    PerftTask t;
+
+    while (pool.pending.load(std::memory_order_acquire) > 0) {
+        if (!pool.pop(w, t)) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        // Stopped: drain the queues without counting so every worker sees pending reach 0
+        if (Signals.stop.load(std::memory_order_relaxed)) {
+            pool.pending.fetch_sub(1, std::memory_order_release);
+            continue;
+        }
+
+        for (int i = 0; i < t.len; i++) pos.make_move(t.path[i]);
+
+        // Always split the root; below that keep splitting while the pool is short of work,
+        // which is what makes narrow roots (few legal moves) spread across every thread.
+        bool split = t.depth > 2 && t.len < PerftTask::MAX_PATH &&
+                     (t.len == 0 || pool.pending.load(std::memory_order_relaxed) < splitBelow);
+        if (split) {
+            MoveList moves;
+            pos.gen_legal_moves(moves);
+            PerftTask child;
+            for (int i = 0; i < t.len; i++) child.path[i] = t.path[i];
+            child.len = t.len + 1;
+            child.depth = t.depth - 1;
+            for (int i = 0; i < moves.count; i++) {
+                child.path[t.len] = moves.moves[i];
+                pool.push(w, child);
+            }
+        } else if (pool.tt) {
+            me.nodes += perft_hashed(pos, t.depth, *pool.tt, me.stats);
+        } else {
+            me.nodes += perft(pos, t.depth);
+        }
+
+        for (int i = 0; i < t.len; i++) pos.undo_move();
+        pool.pending.fetch_sub(1, std::memory_order_release);
+    }
+}
+
+uint64_t perft_parallel(const Position& root, int depth, int threads, PerftTable* tt, PerftStats& stats) {
+    if (threads < 1) threads = 1;
+    PerftPool pool(threads);
+    pool.tt = tt;
+
+    PerftTask start;
+    start.depth = depth;
+    pool.push(0, start);
+
+    std::vector<std::thread> running;
+    for (int w = 1; w < threads; w++) running.emplace_back(perft_worker, std::ref(pool), w, root);
+    perft_worker(pool, 0, root);
+    for (std::thread& th : running) th.join();
+
+    uint64_t nodes = 0;
+    for (PerftWorker& pw : pool.workers) {
+        nodes += pw.nodes;
+        stats.probes += pw.stats.probes;
+        stats.hits += pw.stats.hits;
+    }
+    return nodes;
+}
+
+uint64_t run_perft(Position& pos, int depth, const PerftOptions& opts, PerftTable& tt, PerftStats& stats) {
+    if (opts.threads > 1) return perft_parallel(pos, depth, opts.threads, opts.hashed ? &tt : nullptr, stats);
+    if (opts.hashed) return perft_hashed(pos, depth, tt, stats);
+    return perft(pos, depth);
+}
+
+// Node count below each root move, then the total (the usual way to diff against another engine)
+void perft_divide(Position& pos, int depth) {
+    MoveList moves;
+    pos.gen_legal_moves(moves);
+
+    uint64_t total = 0;
+    for (int i = 0; i < moves.count; i++) {
+        pos.make_move(moves.moves[i]);
+        uint64_t nodes = depth > 1 ? perft(pos, depth - 1) : 1;
+        pos.undo_move();
+        if (Signals.stop.load(std::memory_order_relaxed)) {
+            std::cout << "divide stopped" << std::endl;
+            return;
+        }
+        total += nodes;
+        std::cout << move_to_uci(moves.moves[i]) << ": " << nodes << '\n';
+    }
+    std::cout << "\nmoves " << moves.count << "\nnodes " << total << std::endl;
+}
+
+struct SuiteEntry {
+    const char* name;
+    const char* fen;
+    int depth;
+    uint64_t expected;
+};
+
+// Standard reference positions (chessprogramming wiki perft results, plus the
+// commonly used ep/castling/promotion edge cases), at depths that run in seconds
+static const SuiteEntry PERFT_SUITE[] = {
+    { "startpos",      "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 5, 4865609 },
+    { "kiwipete",      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 4, 4085603 },
+    { "position3",     "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 5, 674624 },
+    { "position4",     "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 4, 422333 },
+    { "position5",     "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8", 4, 2103487 },
+    { "position6",     "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10", 4, 3894594 },
+    { "ep-illegal-1",  "3k4/3p4/8/K1P4r/8/8/8/8 b - - 0 1", 6, 1134888 },
+    { "ep-illegal-2",  "8/8/4k3/8/2p5/8/B2P2K1/8 w - - 0 1", 6, 1015133 },
+    { "ep-check",      "8/8/1k6/2b5/2pP4/8/5K2/8 b - d3 0 1", 6, 1440467 },
+    { "castle-short",  "5k2/8/8/8/8/8/8/4K2R w K - 0 1", 6, 661072 },
+    { "castle-long",   "3k4/8/8/8/8/8/8/R3K3 w Q - 0 1", 6, 803711 },
+    { "castle-rights", "r3k2r/1b4bq/8/8/8/8/7B/R3K2R w KQkq - 0 1", 4, 1274206 },
+    { "castle-block",  "r3k2r/8/3Q4/8/8/5q2/8/R3K2R b KQkq - 0 1", 4, 1720476 },
+    { "promo-evade",   "2K2r2/4P3/8/8/8/8/8/3k4 w - - 0 1", 6, 3821001 },
+    { "discovered",    "8/8/1P2K3/8/2n5/1q6/8/5k2 b - - 0 1", 5, 1004658 },
+    { "promo-check",   "4k3/1P6/8/8/8/8/K7/8 w - - 0 1", 6, 217342 },
+    { "underpromo",    "8/P1k5/K7/8/8/8/8/8 w - - 0 1", 6, 92683 },
+    { "self-stalemate","K1k5/8/P7/8/8/8/8/8 w - - 0 1", 6, 2217 },
+    { "stalemate-mate","8/k1P5/8/1K6/8/8/8/8 w - - 0 1", 7, 567584 },
+    { "mate-stalemate","8/8/2k5/5q2/5n2/8/5K2/8 b - - 0 1", 4, 23527 },
+};
+
+bool perft_suite(const PerftOptions& opts, PerftTable& tt) {
+    int passed = 0, total = 0;
+    uint64_t allNodes = 0;
+    auto suiteStart = std::chrono::steady_clock::now();
+
+    for (const SuiteEntry& e : PERFT_SUITE) {
+        Position pos;
+        pos.set_fen(e.fen);
+        // Fresh table per position so one entry's counts can't leak into the next
+        if (opts.hashed) tt.clear();
+
+        PerftStats stats;
+        auto start = std::chrono::steady_clock::now();
+        uint64_t nodes = run_perft(pos, e.depth, opts, tt, stats);
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        if (Signals.stop.load(std::memory_order_relaxed)) {
+            std::cout << "perftsuite stopped after " << total << " positions" << std::endl;
+            return false;
+        }
+
+        bool ok = nodes == e.expected;
+        passed += ok;
+        total++;
+        allNodes += nodes;
+        std::cout << (ok ? "pass " : "FAIL ") << e.name << " depth " << e.depth << " nodes " << nodes;
+        if (!ok) std::cout << " expected " << e.expected;
+        std::cout << " time " << us / 1000 << " ms nps " << nodes * 1000000 / (uint64_t)(us + 1) << '\n';
+    }
+
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - suiteStart).count();
+    std::cout << "perftsuite " << passed << "/" << total << (passed == total ? " passed" : " FAILED")
+              << " nodes " << allNodes << " time " << us / 1000 << " ms nps "
+              << allNodes * 1000000 / (uint64_t)(us + 1) << std::endl;
+    return passed == total;
+}
+
+// Walk the tree like perft, checking the incremental key against a full recompute
+// after every make_move and every undo_move. Returns the number of mismatches found.
+uint64_t verify_keys(Position& pos, int depth) {
+    uint64_t bad = (pos.key() != pos.compute_key()) || (pos.pawn_key() != pos.compute_pawn_key());
+    if (depth == 0) return bad;
+
+    MoveList moves;
+    pos.gen_legal_moves(moves);
+
+    for (int i = 0; i < moves.count; i++) {
+        uint64_t before = pos.key(), pawnBefore = pos.pawn_key();
+        pos.make_move(moves.moves[i]);
+        bad += verify_keys(pos, depth - 1);
+        pos.undo_move();
+        bad += (pos.key() != before) || (pos.pawn_key() != pawnBefore);
+    }
+    return bad;
+}
+
+static int move_code(const Move& m) { return m.data; }
+
+// Same walk, comparing gen_legal_moves (whole, and as tactical + quiet stages) against the
+// make/unmake filter at every node. Returns the number of nodes where the move sets differ.
+uint64_t verify_legal(Position& pos, int depth) {
+    MoveList fast, tactical, quiet, slow;
+    pos.gen_legal_moves(fast);
+    pos.gen_legal_moves(tactical, GEN_TACTICAL);
+    pos.gen_legal_moves(quiet, GEN_QUIETS);
+    pos.gen_legal_moves_filtered(slow);
+
+    int a[256], b[256], c[256];
+    int staged = 0;
+    for (int i = 0; i < fast.count; i++) a[i] = move_code(fast.moves[i]);
+    for (int i = 0; i < slow.count; i++) b[i] = move_code(slow.moves[i]);
+    for (int i = 0; i < tactical.count && staged < 256; i++) c[staged++] = move_code(tactical.moves[i]);
+    for (int i = 0; i < quiet.count && staged < 256; i++) c[staged++] = move_code(quiet.moves[i]);
+    std::sort(a, a + fast.count);
+    std::sort(b, b + slow.count);
+    std::sort(c, c + staged);
+    uint64_t bad = !(fast.count == slow.count && std::equal(a, a + fast.count, b)) ||
+                   !(staged == slow.count && std::equal(c, c + staged, b));
+    if (depth <= 1) return bad;
+
+    for (int i = 0; i < slow.count; i++) {
+        pos.make_move(slow.moves[i]);
+        bad += verify_legal(pos, depth - 1);
+        pos.undo_move();
+    }
+    return bad;
+}
+
+// Random playouts from the suite positions. At every node is_pseudo_legal && is_legal must
+// accept exactly the generated legal moves: each listed move, plus a pile of candidates
+// that look like what search feeds them (moves from the previous node, as a stale hash
+// move or killer would be, every flag on the listed from/to pairs, and random 16-bit
+// garbage, as from a TT key collision). Returns the number of disagreements.
+uint64_t verify_move_checks(int games, uint64_t seed) {
+    uint64_t rng = seed | 1;
+    auto next = [&rng]() {
+        rng ^= rng >> 12; rng ^= rng << 25; rng ^= rng >> 27;
+        return rng * 2685821657736338717ULL;
+    };
+
+    uint64_t bad = 0, tested = 0;
+    for (const SuiteEntry& e : PERFT_SUITE) {
+        for (int g = 0; g < games; g++) {
+            Position pos;
+            pos.set_fen(e.fen);
+            std::vector<Move> path;
+            MoveList prev;
+            prev.count = 0;
+
+            for (int ply = 0; ply < 200; ply++) {
+                MoveList legal;
+                pos.gen_legal_moves(legal);
+
+                MoveList cand;
+                cand.count = 0;
+                auto add = [&cand](Move m) { if (cand.count < 256) cand.moves[cand.count++] = m; };
+                for (int i = 0; i < legal.count; i++) {
+                    for (int f = 0; f < 16; f++) add(Move(legal.moves[i].from(), legal.moves[i].to(), f));
+                    if (cand.count >= 200) break;
+                }
+                for (int i = 0; i < prev.count && cand.count < 230; i++) add(prev.moves[i]);
+                while (cand.count < 256) {
+                    Move m;
+                    m.data = (uint16_t)next();
+                    add(m);
+                }
+                // Listed moves first, so a false negative on one is always caught
+                for (int i = 0; i < legal.count; i++) {
+                    Move m = legal.moves[i];
+                    tested++;
+                    if (!pos.is_pseudo_legal(m) || !pos.is_legal(m)) {
+                        if (bad++ < 10) {
+                            std::cout << "movecheck rejects legal " << move_to_uci(m) << " flag " << m.flag() << " in " << e.name << " after";
+                            for (Move pm : path) std::cout << ' ' << move_to_uci(pm);
+                            std::cout << '\n';
+                        }
+                    }
+                }
+                for (int i = 0; i < cand.count; i++) {
+                    Move m = cand.moves[i];
+                    bool listed = std::find(legal.moves, legal.moves + legal.count, m) != legal.moves + legal.count;
+                    bool accepted = pos.is_pseudo_legal(m) && pos.is_legal(m);
+                    tested++;
+                    if (listed != accepted && bad++ < 10) {
+                        std::cout << "movecheck " << (accepted ? "accepts " : "rejects ") << move_to_uci(m) << " flag " << m.flag()
+                                  << " in " << e.name << " after";
+                        for (Move pm : path) std::cout << ' ' << move_to_uci(pm);
+                        std::cout << '\n';
+                    }
+                }
+
+                if (legal.count == 0) break;
+                prev = legal;
+                Move m = legal.moves[next() % (uint64_t)legal.count];
+                pos.make_move(m);
+                path.push_back(m);
+            }
+        }
+    }
+    std::cout << "movecheck " << tested << " moves tested" << std::endl;
+    return bad;
+}
+
+// The pre-bitboard way of answering is_square_attacked: step out from s over the mailbox.
+// Kept only as the reference and the baseline for attack_bench.
+static bool attacked_by_walk(const Position& pos, int s, int by) {
+    int f0 = s & 7, r0 = s >> 3;
+    int pr = r0 + (by == WHITE ? -1 : 1); // Rank an attacking pawn would stand on
+    for (int df : { -1, 1 })
+        if (on_board(f0 + df, pr) && pos.piece_on(pr * 8 + f0 + df) == make_piece(by, PAWN)) return true;
+    for (int i = 0; i < 8; i++) {
+        if (on_board(f0 + KNIGHT_DF[i], r0 + KNIGHT_DR[i]) &&
+            pos.piece_on((r0 + KNIGHT_DR[i]) * 8 + f0 + KNIGHT_DF[i]) == make_piece(by, KNIGHT))
+            return true;
+        if (on_board(f0 + KING_DF[i], r0 + KING_DR[i]) &&
+            pos.piece_on((r0 + KING_DR[i]) * 8 + f0 + KING_DF[i]) == make_piece(by, KING))
+            return true;
+    }
+    for (int d = 0; d < 8; d++) {
+        int slider = make_piece(by, d < 4 ? ROOK : BISHOP);
+        for (int f = f0 + RAY_DF[d], r = r0 + RAY_DR[d]; on_board(f, r); f += RAY_DF[d], r += RAY_DR[d]) {
+            int p = pos.piece_on(r * 8 + f);
+            if (p == EMPTY) continue;
+            if (p == slider || p == make_piece(by, QUEEN)) return true;
+            break;
+        }
+    }
+    return false;
+}
+
+// FENs that parse but must not be searched: set_fen + is_sane has to turn them away
+static const char* INSANE_FENS[] = {
+    "8/8/8/8/8/8/8/4K3 w - - 0 1",          // No black king
+    "4k3/8/8/8/8/8/8/4R1K1 w - - 0 1",      // Side not to move is in check
+    "P3k3/8/8/8/8/8/8/4K3 w - - 0 1",       // Pawn on rank 8
+    "4k3/8/8/8/8/8/8/4K2p b - - 0 1",       // Pawn on rank 1
+};
+
+// FENs with an ep square no double push could have left: it must be dropped on load
+static const char* BOGUS_EP_FENS[] = {
+    "4k3/8/8/4P3/8/8/8/4K3 w - d6 0 1",     // Nothing on d5 to capture
+    "4k3/8/8/3pP3/8/8/8/4K3 b - d6 0 1",    // Wrong side to move
+    "4k3/3p4/8/3pP3/8/8/8/4K3 w - d6 0 1",  // d7 still occupied
+    "4k3/8/8/8/3pP3/8/8/4K3 w - e3 0 1",    // Rank 3 with white to move
+};
+
+uint64_t verify_fen_checks() {
+    uint64_t bad = 0;
+    Position pos;
+    for (const char* fen : INSANE_FENS) {
+        if (pos.set_fen(fen) && pos.is_sane()) {
+            bad++;
+            std::cout << "fencheck accepts " << fen << std::endl;
+        }
+    }
+    for (const char* fen : BOGUS_EP_FENS) {
+        if (!pos.set_fen(fen) || !pos.is_sane() || pos.ep() != -1) {
+            bad++;
+            std::cout << "fencheck keeps ep or rejects " << fen << std::endl;
+        }
+    }
+    // And every suite position, ep squares included, still loads untouched
+    for (const SuiteEntry& e : PERFT_SUITE) {
+        const char* epField = e.fen;
+        for (int spaces = 0; *epField && spaces < 3; epField++) spaces += *epField == ' ';
+        bool hasEp = *epField && *epField != '-';
+        if (!pos.set_fen(e.fen) || !pos.is_sane() || (pos.ep() != -1) != hasEp) {
+            bad++;
+            std::cout << "fencheck rejects " << e.name << std::endl;
+        }
+    }
+    return bad;
+}
+
+void attack_bench(int rounds) {
+    std::vector<Position> positions;
+    for (const SuiteEntry& e : PERFT_SUITE) {
+        positions.emplace_back();
+        positions.back().set_fen(e.fen);
+    }
+
+    // Every square, both sides, every position: the same queries through both paths
+    uint64_t mismatches = 0, hitsTable = 0, hitsWalk = 0;
+    for (const Position& pos : positions)
+        for (int s = 0; s < 64; s++)
+            for (int by = 0; by < 2; by++)
+                mismatches += pos.is_square_attacked(s, by) != attacked_by_walk(pos, s, by);
+
+    auto time_ns = [&](auto&& attacked, uint64_t& hits) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < rounds; i++)
+            for (const Position& pos : positions)
+                for (int s = 0; s < 64; s++) hits += attacked(pos, s, WHITE) + attacked(pos, s, BLACK);
+        return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    };
+    double tableNs = time_ns([](const Position& p, int s, int by) { return p.is_square_attacked(s, by); }, hitsTable);
+    double walkNs = time_ns(attacked_by_walk, hitsWalk);
+
+    double calls = (double)rounds * (double)positions.size() * 128.0;
+    std::cout << "attackbench " << (uint64_t)calls << " calls table " << tableNs / calls << " ns walk " << walkNs / calls
+              << " ns speedup " << walkNs / std::max(tableNs, 1.0) << (mismatches || hitsTable != hitsWalk ? " MISMATCH " : " ok ")
+              << mismatches << std::endl;
+}
@@ -0,0 +1,440 @@
+#include "search.h"
+#include "eval.h"
+#include "movepick.h"
+#include "pawns.h"
+#include "stats.h"
+#include "tt.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+SearchSignals Signals;
+
+// Triangular PV: each ply keeps the line below it
+struct PvLine {
+    Move moves[MAX_PLY];
+    int count = 0;
+};
+
+struct Searcher;
+
+// What all threads of one "go" have in common
+struct SearchShared {
+    SearchLimits limits;
+    Clock::time_point start;
+    int64_t soft_ms = -1; // Don't start another iteration past this (-1 = no limit)
+    int64_t hard_ms = -1; // Abort the current iteration past this
+    std::atomic<bool> stop{false};
+    std::vector<Searcher*> threads;
+    // Only the main thread touches these
+    bool pondering = false;
+    int64_t last_stats_ms = 0;
+    int64_t clock_base = 0; // Time limits count from here: 0, or the ponderhit
+
+    int64_t elapsed() const {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count();
+    }
+    int64_t clock() const { return elapsed() - clock_base; }
+    void poll_ponderhit() {
+        if (pondering && Signals.ponderhit.load(std::memory_order_relaxed)) {
+            pondering = false;
+            clock_base = elapsed();
+        }
+    }
+    uint64_t total_nodes() const;
+};
+
+// One search thread: its own copy of the position, sharing only the TT and the stop flag.
+// Thread 0 is the main thread that watches the clock and prints info lines.
+struct Searcher {
+    int id = 0;
+    SearchShared* shared = nullptr;
+    Position pos;
+    std::unique_ptr<NnueStack> nnue; // Only when a net is loaded
+    std::unique_ptr<PawnTable> pawns = std::make_unique<PawnTable>();
+    std::atomic<uint64_t> nodes{0};
+    int iter_depth = 0;
+    Move root_best; // Searched first at the root, from the previous iteration
+    SearchResult result; // Last iteration this thread completed
+
+    // Move ordering, private to this thread and fresh for every "go"
+    Move killers[MAX_PLY][2];
+    ButterflyHistory history = {};
+
+    // Depth 1 always completes so there is a move to play
+    void check_limits() {
+        shared->poll_ponderhit();
+        // Stats builds: the counters so far, at most once a second
+        if (CHESSBOT_STATS && !shared->limits.silent && shared->elapsed() >= shared->last_stats_ms + 1000) {
+            shared->last_stats_ms = shared->elapsed();
+            std::cout << stats_report() << std::flush;
+        }
+        if (iter_depth <= 1) return;
+        if (Signals.stop.load(std::memory_order_relaxed)) {
+            shared->stop.store(true, std::memory_order_relaxed);
+            return;
+        }
+        if (shared->pondering) return;
+        const SearchLimits& l = shared->limits;
+        if ((l.nodes && shared->total_nodes() >= l.nodes) ||
+            (shared->hard_ms >= 0 && shared->clock() >= shared->hard_ms))
+            shared->stop.store(true, std::memory_order_relaxed);
+    }
+
+    int negamax(int depth, int ply, int alpha, int beta, PvLine& pv);
+    int qsearch(int ply, int alpha, int beta);
+    void iterate(int rootMoveCount);
+    void update_quiet_stats(const Move& best, int ply, int depth, const Move* tried, int triedCount);
+
+    // Searchers are reused from one search to the next (see search()): back to a fresh one
+    void reset(SearchShared* sh, int i, const Position& root, const Move& firstMove) {
+        id = i;
+        shared = sh;
+        pos = root;
+        if (nnue_loaded()) {
+            if (!nnue) nnue = std::make_unique<NnueStack>();
+            nnue->reset(pos);
+            pos.attach_nnue(nnue.get());
+        }
+        pawns->clear();
+        nodes.store(0, std::memory_order_relaxed);
+        iter_depth = 0;
+        root_best = Move();
+        result = SearchResult{};
+        result.best = firstMove;
+        for (auto& k : killers) k[0] = k[1] = Move();
+        std::memset(history, 0, sizeof(history));
+    }
+};
+
+uint64_t SearchShared::total_nodes() const {
+    uint64_t n = 0;
+    for (const auto& t : threads) n += t->nodes.load(std::memory_order_relaxed);
+    return n;
+}
+
+// Soft limit: expected share of the remaining time. Hard limit: never more than a few
+// times that, and never close to the whole clock.
+static void allot_time(const SearchLimits& l, int side, int64_t& soft, int64_t& hard) {
+    soft = hard = -1;
+    if (l.infinite) return;
+    if (l.movetime > 0) {
+        soft = hard = l.movetime;
+        return;
+    }
+    if (l.time[side] <= 0) return;
+
+    const int64_t overhead = 30; // GUI/pipe latency
+    int64_t avail = std::max<int64_t>(1, l.time[side] - overhead);
+    int movesLeft = l.movestogo > 0 ? std::min(l.movestogo, 40) : 30;
+
+    soft = std::min(avail / movesLeft + l.inc[side] * 3 / 4, avail / 2);
+    hard = std::min(soft * 4, avail * 3 / 4);
+    soft = std::max<int64_t>(1, std::min(soft, hard));
+}
+
+// A quiet move caused a cutoff: make it a killer for this ply and reward it in the history,
+// and penalize the quiets that were tried before it and failed
+void Searcher::update_quiet_stats(const Move& best, int ply, int depth, const Move* tried, int triedCount) {
+    if (killers[ply][0] != best) {
+        killers[ply][1] = killers[ply][0];
+        killers[ply][0] = best;
+    }
+    int side = pos.side_to_move();
+    int bonus = std::min(depth * depth, 400);
+    update_history(history[side][best.from()][best.to()], bonus * 32);
+    for (int i = 0; i < triedCount; i++)
+        update_history(history[side][tried[i].from()][tried[i].to()], -bonus * 32);
+}
+
+int Searcher::negamax(int depth, int ply, int alpha, int beta, PvLine& pv) {
+    pv.count = 0;
+    // Only this thread writes its counter; the atomic is just so the main thread can read it
+    uint64_t n = nodes.load(std::memory_order_relaxed) + 1;
+    nodes.store(n, std::memory_order_relaxed);
+    if ((n & 1023) == 0) {
+        STATS_SEARCH_FLUSH();
+        if (id == 0) check_limits();
+    }
+    if (shared->stop.load(std::memory_order_relaxed)) return 0;
+    STATS_INC(nodes);
+
+    if (ply > 0 && pos.is_repetition()) return 0;
+    if (depth <= 0) return qsearch(ply, alpha, beta);
+    if (ply >= MAX_PLY - 1) return evaluate(pos, pawns.get());
+
+    // A stored result at least this deep can settle the node (never at the root, which needs a move)
+    TTData tte;
+    bool ttHit = TT.probe(pos.key(), tte);
+    if (ttHit && ply > 0 && tte.depth >= depth) {
+        int ttScore = score_from_tt(tte.score, ply);
+        if (tte.bound == BOUND_EXACT ||
+            (tte.bound == BOUND_LOWER && ttScore >= beta) ||
+            (tte.bound == BOUND_UPPER && ttScore <= alpha))
+            return ttScore;
+    }
+
+    // Hash move first; at the root that is the best move of the previous iteration
+    Move hashMove = (ply == 0) ? root_best : (ttHit ? tte.move : Move{});
+    MovePicker picker(pos, hashMove, killers[ply], history);
+
+    int origAlpha = alpha;
+    int best = -INF_SCORE;
+    Move bestMove;
+    PvLine child;
+    Move quiets[64]; // Tried before the cutoff move, they get a history malus
+    int quietCount = 0;
+    int moveCount = 0;
+    Move m;
+    while (picker.next(m)) {
+        bool quiet = !pos.is_capture(m) && !m.is_promo();
+        moveCount++;
+        pos.make_move(m);
+        int score = -negamax(depth - 1, ply + 1, -beta, -alpha, child);
+        pos.undo_move();
+        if (shared->stop.load(std::memory_order_relaxed)) return 0;
+
+        if (score > best) {
+            best = score;
+            bestMove = m;
+            if (score > alpha) {
+                alpha = score;
+                pv.moves[0] = m;
+                for (int j = 0; j < child.count; j++) pv.moves[j + 1] = child.moves[j];
+                pv.count = child.count + 1;
+                if (alpha >= beta) {
+                    STATS_CUTOFF(moveCount);
+                    if (quiet) update_quiet_stats(m, ply, depth, quiets, quietCount);
+                    break;
+                }
+            }
+        }
+        if (quiet && quietCount < 64) quiets[quietCount++] = m;
+    }
+
+    if (moveCount == 0) {
+        // Checkmate (prefer the shortest) or stalemate
+        return pos.is_in_check(pos.side_to_move()) ? -MATE_SCORE + ply : 0;
+    }
+
+    int bound = best >= beta ? BOUND_LOWER : (best > origAlpha ? BOUND_EXACT : BOUND_UPPER);
+    TT.store(pos.key(), depth, bound, score_to_tt(best, ply), bestMove);
+    return best;
+}
+
+// Quiescence: at the horizon keep playing captures and promotions (only ones SEE doesn't
+// call losing) until the position is quiet, so the static eval never sees a half-done
+// exchange. The side to move can always stand pat, except in check, where every evasion
+// is searched instead.
+int Searcher::qsearch(int ply, int alpha, int beta) {
+    uint64_t n = nodes.load(std::memory_order_relaxed) + 1;
+    nodes.store(n, std::memory_order_relaxed);
+    if ((n & 1023) == 0) {
+        STATS_SEARCH_FLUSH();
+        if (id == 0) check_limits();
+    }
+    if (shared->stop.load(std::memory_order_relaxed)) return 0;
+    STATS_INC(qnodes);
+    if (ply >= MAX_PLY - 1) return evaluate(pos, pawns.get());
+
+    bool inCheck = pos.is_in_check(pos.side_to_move());
+    int best = -INF_SCORE;
+    if (!inCheck) {
+        best = evaluate(pos, pawns.get());
+        if (best >= beta) return best;
+        alpha = std::max(alpha, best);
+    }
+
+    MovePicker picker = inCheck ? MovePicker(pos, Move{}, killers[ply], history) : MovePicker(pos);
+    int moveCount = 0;
+    Move m;
+    while (picker.next(m)) {
+        moveCount++;
+        pos.make_move(m);
+        int score = -qsearch(ply + 1, -beta, -alpha);
+        pos.undo_move();
+        if (shared->stop.load(std::memory_order_relaxed)) return 0;
+
+        if (score > best) {
+            best = score;
+            if (score > alpha) {
+                alpha = score;
+                if (alpha >= beta) break;
+            }
+        }
+    }
+
+    if (inCheck && moveCount == 0) return -MATE_SCORE + ply;
+    return best;
+}
+
+// Built up first and written in one go, so a "readyok" from the reader thread can't land
+// in the middle of the line
+static void print_info(const SearchShared& sh, int depth, int score, const PvLine& pv) {
+    int64_t ms = sh.elapsed();
+    uint64_t nodes = sh.total_nodes();
+    std::ostringstream out;
+    out << "info depth " << depth << " score ";
+    if (score >= MATE_BOUND) out << "mate " << (MATE_SCORE - score + 1) / 2;
+    else if (score <= -MATE_BOUND) out << "mate -" << (MATE_SCORE + score) / 2;
+    else out << "cp " << score;
+    out << " nodes " << nodes << " nps " << nodes * 1000 / (uint64_t)(ms + 1) << " time " << ms
+        << " hashfull " << TT.hashfull() << " pv";
+    for (int i = 0; i < pv.count; i++) out << ' ' << move_to_uci(pv.moves[i]);
+    out << '\n';
+    std::cout << out.str() << std::flush;
+}
+
+// Lazy SMP: helpers run the same iterative deepening but skip some depths, in a pattern that
+// differs per thread, so at any moment the threads are spread over neighbouring depths and
+// fill the shared TT for each other instead of all repeating the same work.
+static const int SKIP_SIZE[20]  = { 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4 };
+static const int SKIP_PHASE[20] = { 0, 1, 0, 1, 2, 3, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 6, 7 };
+
+void Searcher::iterate(int rootMoveCount) {
+    const SearchLimits& limits = shared->limits;
+    STATS_SEARCH_BEGIN();
+    int maxDepth = limits.depth > 0 ? std::min(limits.depth, MAX_PLY - 1) : MAX_PLY - 1;
+
+    for (int depth = 1; depth <= maxDepth; depth++) {
+        if (id > 0) {
+            int i = (id - 1) % 20;
+            if (((depth + SKIP_PHASE[i]) / SKIP_SIZE[i]) % 2) continue;
+        }
+        iter_depth = depth;
+        PvLine pv;
+        int score = negamax(depth, 0, -INF_SCORE, INF_SCORE, pv);
+        if (shared->stop.load(std::memory_order_relaxed)) break;
+
+        if (pv.count > 0) {
+            result.best = pv.moves[0];
+            root_best = pv.moves[0];
+        }
+        result.score = score;
+        result.depth = depth;
+        if (id != 0) continue;
+
+        if (!limits.silent) print_info(*shared, depth, score, pv);
+
+        shared->poll_ponderhit();
+        if (Signals.stop.load(std::memory_order_relaxed)) break;
+        // Only one move, or a forced mate found: no point looking deeper
+        if (!limits.infinite && (rootMoveCount == 1 || std::abs(score) >= MATE_BOUND) && limits.depth == 0) break;
+        if (shared->pondering) continue;
+        if (limits.nodes && shared->total_nodes() >= limits.nodes) break;
+        // The next iteration takes several times longer than this one, don't start what can't finish
+        if (shared->soft_ms >= 0 && shared->clock() >= shared->soft_ms / 2) break;
+    }
+
+    STATS_SEARCH_FLUSH(); // Waiting for the GUI below isn't search time
+
+    // Out of depth (or mate found) early: the GUI still gets no bestmove until it asks for one
+    if (id == 0) {
+        while ((limits.infinite || shared->pondering) && !Signals.stop.load(std::memory_order_relaxed)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            shared->poll_ponderhit();
+        }
+    }
+}
+
+SearchResult search(Position& pos, const SearchLimits& limits, int threads) {
+    SearchShared sh;
+    sh.limits = limits;
+    sh.start = Clock::now();
+    sh.pondering = limits.ponder;
+    allot_time(limits, pos.side_to_move(), sh.soft_ms, sh.hard_ms);
+    if (limits.age_tt) TT.new_search();
+
+    MoveList rootMoves;
+    pos.gen_legal_moves(rootMoves);
+    if (rootMoves.count == 0) {
+        // Mated or stalemated: nothing to play, so no best move, but still a score (from the
+        // side to move's view, like every other). Infinite and ponder still wait to be asked.
+        SearchResult r;
+        bool mated = pos.is_in_check(pos.side_to_move());
+        r.score = mated ? -MATE_SCORE : 0;
+        if (!limits.silent) std::cout << (mated ? "info depth 0 score mate 0\n" : "info depth 0 score cp 0\n") << std::flush;
+        while ((limits.infinite || sh.pondering) && !Signals.stop.load(std::memory_order_relaxed)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            sh.poll_ponderhit();
+        }
+        return r;
+    }
+
+    // Searchers (with their 512 KB pawn tables) stay with the calling thread and are reset
+    // for its next search, so a batch worker running thousands of short ones allocates once
+    static thread_local std::vector<std::unique_ptr<Searcher>> pool;
+    for (int i = 0; i < std::max(1, threads); i++) {
+        if (i == (int)pool.size()) pool.push_back(std::make_unique<Searcher>());
+        pool[i]->reset(&sh, i, pos, rootMoves.moves[0]);
+        sh.threads.push_back(pool[i].get());
+    }
+
+    std::vector<std::thread> helpers;
+    for (size_t i = 1; i < sh.threads.size(); i++)
+        helpers.emplace_back(&Searcher::iterate, sh.threads[i], rootMoves.count);
+    sh.threads[0]->iterate(rootMoves.count);
+
+    // Main thread is done (limits hit or max depth): stop the helpers and collect
+    sh.stop.store(true, std::memory_order_relaxed);
+    for (std::thread& h : helpers) h.join();
+
+    // Take the deepest completed iteration of any thread, the main thread wins ties
+    SearchResult best = sh.threads[0]->result;
+    for (size_t i = 1; i < sh.threads.size(); i++) {
+        const SearchResult& r = sh.threads[i]->result;
+        if (r.depth > best.depth) best = r;
+    }
+    best.nodes = sh.total_nodes();
+    if (CHESSBOT_STATS && !limits.silent) std::cout << stats_report() << std::flush;
+    return best;
+}
+
+// Middlegame positions with plenty of play, so time-to-depth isn't dominated by a few forced lines
+static const char* BENCH_FENS[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+    "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+    "r1bq1rk1/pp2bppp/2n1pn2/3p4/2PP4/2N1PN2/PP3PPP/R2QKB1R w KQ - 0 8",
+    "2r2rk1/pp1bqppp/2n1pn2/3p4/3P4/2PBPN2/P1Q2PPP/R1B2RK1 w - - 0 12",
+};
+
+void smp_bench(int depth, int maxThreads, size_t hashMb) {
+    double baseMs = 0;
+    for (int threads = 1; ; threads = std::min(threads * 2, maxThreads)) {
+        // Same table size and a cold table for every run, so only the thread count changes
+        TT.resize(hashMb, threads);
+        int64_t ms = 0;
+        uint64_t nodes = 0;
+
+        for (const char* fen : BENCH_FENS) {
+            Position pos;
+            pos.set_fen(fen);
+            TT.clear(threads);
+            SearchLimits limits;
+            limits.depth = depth;
+            limits.silent = true;
+
+            auto start = Clock::now();
+            nodes += search(pos, limits, threads).nodes;
+            ms += std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count();
+        }
+
+        if (threads == 1) baseMs = (double)std::max<int64_t>(ms, 1);
+        std::cout << "smpbench threads " << threads << " depth " << depth << " time " << ms << " ms nodes " << nodes
+                  << " nps " << nodes * 1000 / (uint64_t)(ms + 1) << " speedup " << baseMs / (double)std::max<int64_t>(ms, 1)
+                  << std::endl;
+        if (threads >= maxThreads) break;
+    }
+    TT.clear(maxThreads);
+}
@@ -0,0 +1,95 @@
+#include "stats.h"
+
+#include <algorithm>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+// Every live thread's block, plus what threads that have exited left behind
+static std::mutex registry_lock;
+static std::vector<ThreadStats*> live;
+static StatsTotals retired;
+
+static void accumulate(StatsTotals& t, const ThreadStats& s) {
+    t.nodes += s.nodes.get();
+    t.qnodes += s.qnodes.get();
+    t.tt_probes += s.tt_probes.get();
+    t.tt_hits += s.tt_hits.get();
+    t.pawn_probes += s.pawn_probes.get();
+    t.pawn_hits += s.pawn_hits.get();
+    for (int i = 0; i < CUTOFF_BUCKETS; i++) t.cutoffs[i] += s.cutoffs[i].get();
+    t.movegen_calls += s.movegen_calls.get();
+    t.makes += s.makes.get();
+    t.undos += s.undos.get();
+    t.movegen_ns += s.movegen_ns.get();
+    t.eval_ns += s.eval_ns.get();
+    t.search_ns += s.search_ns.get();
+}
+
+// One per thread: joins the registry on first use, hands its counts over when the thread ends
+struct StatsRegistration {
+    ThreadStats stats;
+    StatsRegistration() {
+        std::lock_guard<std::mutex> g(registry_lock);
+        live.push_back(&stats);
+    }
+    ~StatsRegistration() {
+        std::lock_guard<std::mutex> g(registry_lock);
+        accumulate(retired, stats);
+        live.erase(std::find(live.begin(), live.end(), &stats));
+    }
+};
+
+ThreadStats& thread_stats() {
+    thread_local StatsRegistration reg;
+    return reg.stats;
+}
+
+StatsTotals stats_snapshot() {
+    std::lock_guard<std::mutex> g(registry_lock);
+    StatsTotals t = retired;
+    for (const ThreadStats* s : live) accumulate(t, *s);
+    return t;
+}
+
+void stats_reset() {
+    std::lock_guard<std::mutex> g(registry_lock);
+    retired = StatsTotals{};
+    for (ThreadStats* s : live) {
+        for (StatCounter* c : { &s->nodes, &s->qnodes, &s->tt_probes, &s->tt_hits, &s->pawn_probes, &s->pawn_hits, &s->movegen_calls, &s->makes,
+                                &s->undos, &s->movegen_ns, &s->eval_ns, &s->search_ns })
+            c->v.store(0, std::memory_order_relaxed);
+        for (StatCounter& c : s->cutoffs) c.v.store(0, std::memory_order_relaxed);
+    }
+}
+
+static double pct(uint64_t part, uint64_t whole) { return whole ? 100.0 * (double)part / (double)whole : 0.0; }
+
+std::string stats_report() {
+    if (!CHESSBOT_STATS) return "info string stats not built in (configure with -DCHESSBOT_STATS=ON)\n";
+
+    StatsTotals t = stats_snapshot();
+    std::ostringstream out;
+    out.setf(std::ios::fixed);
+    out.precision(1);
+    out << "info string stats nodes " << t.nodes << " qnodes " << t.qnodes << " tt probes " << t.tt_probes << " hits "
+        << t.tt_hits << " (" << pct(t.tt_hits, t.tt_probes) << "%) pawn probes " << t.pawn_probes << " hits "
+        << t.pawn_hits << " (" << pct(t.pawn_hits, t.pawn_probes) << "%) movegen " << t.movegen_calls << " make "
+        << t.makes << " undo " << t.undos << '\n';
+
+    uint64_t cuts = 0;
+    for (uint64_t c : t.cutoffs) cuts += c;
+    static const char* BUCKET_NAMES[CUTOFF_BUCKETS] = { "1", "2", "3", "4", "5-8", "9-16", "17+" };
+    out << "info string stats cutoffs " << cuts << " by move";
+    for (int i = 0; i < CUTOFF_BUCKETS; i++) out << ' ' << BUCKET_NAMES[i] << ':' << pct(t.cutoffs[i], cuts) << '%';
+    out << '\n';
+
+    // Search time is per thread too and accrues every 1024 nodes, so the three add up even
+    // mid-search; "other" is the tree walk itself (move ordering, TT, make/undo). Movegen and
+    // eval outside a search (perft, the eval command) count too.
+    uint64_t other = t.search_ns > t.movegen_ns + t.eval_ns ? t.search_ns - t.movegen_ns - t.eval_ns : 0;
+    out << "info string stats time search " << t.search_ns / 1000000 << " ms movegen " << t.movegen_ns / 1000000
+        << " ms (" << pct(t.movegen_ns, t.search_ns) << "%) eval " << t.eval_ns / 1000000 << " ms ("
+        << pct(t.eval_ns, t.search_ns) << "%) other " << other / 1000000 << " ms (" << pct(other, t.search_ns) << "%)\n";
+    return out.str();
+}
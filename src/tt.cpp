@@ -0,0 +1,130 @@
+#include "tt.h"
+#include "search.h"
+#include "stats.h"
+
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+TranspositionTable TT;
+
+static uint64_t load(const uint64_t& w) {
+    return std::atomic_ref<uint64_t>(const_cast<uint64_t&>(w)).load(std::memory_order_relaxed);
+}
+static void save(uint64_t& w, uint64_t v) {
+    std::atomic_ref<uint64_t>(w).store(v, std::memory_order_relaxed);
+}
+
+static uint64_t pack_move(const Move& m) { return m.data; }
+static Move unpack_move(uint64_t v) {
+    Move m;
+    m.data = (uint16_t)(v & 0xFFFF);
+    return m;
+}
+
+static int data_depth(uint64_t d) { return (int)((d >> 32) & 0xFF); }
+static int data_bound(uint64_t d) { return (int)((d >> 40) & 3); }
+static int data_age(uint64_t d) { return (int)((d >> 42) & 63); }
+
+void TranspositionTable::resize(size_t mb, int threads) {
+    size_t want = (mb << 20) / sizeof(Bucket);
+    // Round down to a power of two so the index is just a mask
+    size_t n = 1;
+    while (n * 2 <= want) n *= 2;
+    if (n != buckets) {
+        table.reset();
+        table.reset(new Bucket[n]);
+        buckets = n;
+    }
+    clear(threads);
+}
+
+void TranspositionTable::clear(int threads) {
+    if (threads < 1) threads = 1;
+    age = 0;
+    size_t chunk = (buckets + threads - 1) / threads;
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        size_t first = chunk * t;
+        if (first >= buckets) break;
+        size_t count = std::min(chunk, buckets - first);
+        workers.emplace_back([this, first, count]() {
+            std::memset(static_cast<void*>(&table[first]), 0, count * sizeof(Bucket));
+        });
+    }
+    for (std::thread& w : workers) w.join();
+}
+
+void TranspositionTable::new_search() {
+    age = (uint8_t)((age + 1) & 63);
+}
+
+bool TranspositionTable::probe(uint64_t key, TTData& out) const {
+    STATS_INC(tt_probes);
+    const Bucket& b = table[key & (buckets - 1)];
+    for (const Entry& e : b.e) {
+        uint64_t data = load(e.data);
+        if ((load(e.check) ^ data) != key || data_bound(data) == BOUND_NONE) continue;
+        out.move = unpack_move(data);
+        out.score = (int16_t)((data >> 16) & 0xFFFF);
+        out.depth = data_depth(data);
+        out.bound = data_bound(data);
+        STATS_INC(tt_hits);
+        return true;
+    }
+    return false;
+}
+
+void TranspositionTable::store(uint64_t key, int depth, int bound, int score, const Move& m) {
+    Bucket& b = table[key & (buckets - 1)];
+
+    // Same position first, otherwise the entry worth least: shallow, or left over from old searches
+    Entry* victim = nullptr;
+    int worst = 1 << 30;
+    for (Entry& e : b.e) {
+        uint64_t data = load(e.data);
+        if ((load(e.check) ^ data) == key) {
+            victim = &e;
+            break;
+        }
+        int stale = (age - data_age(data)) & 63;
+        int value = data_depth(data) - 8 * stale;
+        if (value < worst) {
+            worst = value;
+            victim = &e;
+        }
+    }
+
+    uint64_t data = pack_move(m)
+                  | ((uint64_t)(uint16_t)(int16_t)score << 16)
+                  | ((uint64_t)(depth & 0xFF) << 32)
+                  | ((uint64_t)(bound & 3) << 40)
+                  | ((uint64_t)age << 42);
+    save(victim->check, key ^ data);
+    save(victim->data, data);
+}
+
+int TranspositionTable::hashfull() const {
+    int used = 0;
+    size_t sample = std::min<size_t>(250, buckets);
+    for (size_t i = 0; i < sample; i++) {
+        for (const Entry& e : table[i].e) {
+            uint64_t data = load(e.data);
+            if (data_bound(data) != BOUND_NONE && data_age(data) == age) used++;
+        }
+    }
+    return (int)(used * 1000 / (sample * 4));
+}
+
+int score_to_tt(int score, int ply) {
+    if (score >= MATE_BOUND) return score + ply;
+    if (score <= -MATE_BOUND) return score - ply;
+    return score;
+}
+
+int score_from_tt(int score, int ply) {
+    if (score >= MATE_BOUND) return score - ply;
+    if (score <= -MATE_BOUND) return score + ply;
+    return score;
+}
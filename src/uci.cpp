@@ -1,22 +1,68 @@
-#include "defs.h"
+#include "position.h"
+#include "batch.h"
+#include "book.h"
+#include "eval.h"
+#include "nnue.h"
+#include "perft.h"
+#include "search.h"
+#include "stats.h"
+#include "tt.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
 #include <iostream>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
 
-uint64_t perft(int depth);
-void perft_divide(int depth);
+// The position the GUI is talking about
+static Position pos;
+
+// UCI options
+static int hash_mb = 16;
+static int search_threads = 1;
+static bool book_best = false;
+
+static PolyglotBook book;
+
+// Only allocated once a hashed perft is actually run
+static PerftTable perft_tt;
 
 static void dump_board() {
     // This prints backwards from the actual storage but is most intuitively displayed this way.
     for (int r = 7; r >= 0; --r) {
         std::cout << (r + 1) << "  ";
         for (int f = 0; f < 8; ++f) {
-            std::cout << piece_to_char(board[r * 8 + f]) << ' ';
+            std::cout << piece_to_char(pos.piece_on(r * 8 + f)) << ' ';
         }
         std::cout << '\n';
     }
     std::cout << "\n   a b c d e f g h\n";
-    std::cout << "side: " << (side_to_move == WHITE ? "w" : "b") << '\n';
+    std::cout << "side: " << (pos.side_to_move() == WHITE ? "w" : "b") << '\n';
+}
+
+// What pos was last set up from ("startpos" or "fen ...") and the moves played on top of it.
+// GUIs resend the whole game every move, so usually only the last move or two are new.
+static std::string pos_base;
+static std::vector<std::string> pos_moves;
+
+// Moves go in one by one, each validated on its own rather than trusted to make_move; on a
+// bad one pos stays at the last good position
+static bool apply_uci_moves(const std::vector<std::string>& moves, size_t from) {
+    for (size_t i = from; i < moves.size(); i++) {
+        Move m;
+        if (!parse_uci_move(pos, moves[i], m) || !pos.is_pseudo_legal(m) || !pos.is_legal(m)) {
+            std::cout << "info string illegal move in position command: " << moves[i] << std::endl;
+            return false;
+        }
+        pos.make_move(m);
+        pos_moves.push_back(moves[i]);
+    }
+    return true;
 }
 
 static void handle_position(const std::string& line) {
@@ -24,71 +70,387 @@ static void handle_position(const std::string& line) {
     std::string word;
     std::string tok;
     iss >> word; iss >> word; // Position, then "startpos" or "fen"
-    bool hasMoves = false; // Detect if we are given "moves" afterwards
+    std::string base;
     if (word == "startpos") {
-        set_startpos();
-        while (iss >> tok) {
-            if (tok == "moves") { hasMoves = true; break; }
-        }
-        if (!hasMoves) return;
+        base = word;
+        while (iss >> tok && tok != "moves") {} // Iss is now right after "moves", if any
     } else if (word == "fen") {
         // Read fen fields until "moves" or end
-        std::string fen;
-        while (iss >> tok) {
-            if (tok == "moves") { hasMoves = true; break; }
-            if (!fen.empty()) fen += ' ';
-            fen += tok; // Construct FEN
-        }
-        if (!set_fen(fen.c_str())) {
-            std::cerr << "Invalid FEN\n"; // Debug
-            return;
-        }
-        // Iss is now positioned right after "moves".
+        base = word;
+        while (iss >> tok && tok != "moves") base += ' ' + tok;
     } else {
         // Bad formatting
         return;
     }
-    if (hasMoves) {
+    std::vector<std::string> moves;
+    while (iss >> tok) moves.push_back(tok);
+
+    // Same start and the moves we have are the beginning of the new list (the usual case):
+    // only play the rest. A shorter list (takeback) is undone back to where they agree.
+    if (base == pos_base) {
+        size_t common = 0;
+        while (common < moves.size() && common < pos_moves.size() && moves[common] == pos_moves[common]) common++;
+        size_t back = pos_moves.size() - common;
+        if (back <= (size_t)pos.game_ply()) {
+            for (; back > 0; back--) {
+                pos.undo_move();
+                pos_moves.pop_back();
+            }
+            apply_uci_moves(moves, common);
+            return;
+        }
+    }
+
+    pos_moves.clear();
+    if (base == "startpos") {
+        pos.set_startpos();
+    } else if (!pos.set_fen(base.c_str() + 4) || !pos.is_sane()) {
+        // Never left half set up or kingless (eval and NNUE index by king square): back to
+        // the start position, which the next "position" command can build on as usual
+        std::cout << "info string invalid position, using startpos: " << base.substr(4) << std::endl;
+        pos.set_startpos();
+        pos_base = "startpos";
+        return;
+    }
+    pos_base = base;
+    apply_uci_moves(moves, 0);
+}
+
+static void handle_setoption(const std::string& line) {
+    // setoption name <id> [value <x>]
+    std::istringstream iss(line);
+    std::string tok, name, value;
+    iss >> tok; // setoption
+    iss >> tok; // name
+    while (iss >> tok && tok != "value") name += (name.empty() ? "" : " ") + tok;
+    std::getline(iss >> std::ws, value);
+
+    if (name == "Hash") {
+        int mb = std::atoi(value.c_str());
+        if (mb >= 1 && mb <= 65536) {
+            hash_mb = mb;
+            TT.resize((size_t)hash_mb, search_threads);
+        }
+    } else if (name == "Threads") {
+        int n = std::atoi(value.c_str());
+        if (n >= 1 && n <= 1024) search_threads = n;
+    } else if (name == "EvalFile") {
+        std::string error;
+        if (value.empty() || value == "<empty>") {
+            nnue_unload();
+            std::cout << "info string classical evaluation" << std::endl;
+        } else if (nnue_load(value, error)) {
+            std::cout << "info string NNUE evaluation using " << value << " (" << nnue_kernel_name() << ")" << std::endl;
+        } else {
+            std::cout << "info string EvalFile not loaded: " << error << std::endl;
+        }
+    } else if (name == "BookFile") {
+        std::string error;
+        if (value.empty() || value == "<empty>") {
+            book.close();
+        } else if (book.open(value, error)) {
+            std::cout << "info string BookFile " << value << " (" << book.size() << " entries)" << std::endl;
+        } else {
+            std::cout << "info string BookFile not loaded: " << error << std::endl;
+        }
+    } else if (name == "BookBestMove") {
+        book_best = (value == "true");
+    }
+}
+
+// Shared by perft and perftsuite: [threads N] [hash [MB]], MB defaults to the Hash option
+static PerftOptions parse_perft_options(std::istringstream& iss) {
+    PerftOptions opts;
+    opts.hash_mb = (size_t)hash_mb;
+
+    std::string tok;
+    while (iss >> tok) {
+        if (tok == "hash") {
+            opts.hashed = true;
+            int n;
+            if (iss >> n) opts.hash_mb = (size_t)n;
+            else iss.clear();
+        } else if (tok == "threads") {
+            iss >> opts.threads;
+            if (opts.threads < 1) opts.threads = 1;
+        }
+    }
+    if (opts.hashed) perft_tt.resize(opts.hash_mb);
+    return opts;
+}
+
+// perft <depth> [threads N] [hash [MB]] - "hash" caches subtree counts
+static void handle_perft(std::istringstream& iss) {
+    int depth = 0;
+    iss >> depth;
+    PerftOptions opts = parse_perft_options(iss);
+
+    auto start = std::chrono::steady_clock::now();
+    PerftStats stats;
+    uint64_t nodes = run_perft(pos, depth, opts, perft_tt, stats);
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    if (Signals.stop) {
+        std::cout << "perft stopped after " << ms << " ms" << std::endl;
+        return;
+    }
+
+    std::cout << "nodes " << nodes << std::endl;
+    std::cout << "info string threads " << opts.threads << " time " << ms << " ms nps " << (nodes * 1000 / (uint64_t)(ms + 1));
+    if (opts.hashed) {
+        std::cout << " hash " << perft_tt.size_mb() << " MB hits " << stats.hits << "/" << stats.probes
+                  << " (" << (stats.probes ? 100.0 * (double)stats.hits / (double)stats.probes : 0.0) << "%)";
+    }
+    std::cout << std::endl;
+}
+
+// go [depth D] [movetime MS] [nodes N] [wtime MS] [btime MS] [winc MS] [binc MS] [movestogo N] [infinite] [ponder]
+static void handle_go(std::istringstream& iss) {
+    SearchLimits limits;
+    std::string tok;
+    while (iss >> tok) {
+        if (tok == "depth") iss >> limits.depth;
+        else if (tok == "movetime") iss >> limits.movetime;
+        else if (tok == "nodes") iss >> limits.nodes;
+        else if (tok == "wtime") iss >> limits.time[WHITE];
+        else if (tok == "btime") iss >> limits.time[BLACK];
+        else if (tok == "winc") iss >> limits.inc[WHITE];
+        else if (tok == "binc") iss >> limits.inc[BLACK];
+        else if (tok == "movestogo") iss >> limits.movestogo;
+        else if (tok == "infinite") limits.infinite = true;
+        else if (tok == "ponder") limits.ponder = true;
+    }
+
+    // A book hit answers straight away, no search or thread startup at all. Not while
+    // pondering or infinite, where bestmove has to wait for the GUI.
+    Move bookMove;
+    if (!limits.infinite && !limits.ponder && book.probe(pos, book_best, bookMove)) {
+        std::cout << "info string book move\nbestmove " + move_to_uci(bookMove) + "\n" << std::flush;
+        return;
+    }
+
+    SearchResult r = search(pos, limits, search_threads);
+    // One write, so it can't interleave with a "readyok" from the reader thread
+    std::cout << "bestmove " + (r.best.is_none() ? std::string("0000") : move_to_uci(r.best)) + "\n" << std::flush;
+}
+
+// The commands that can run for a while (the rest of its line in args)
+static void run_long_command(const std::string& cmd, std::istringstream& iss) {
+    if (cmd == "perft") { // Debug
+        handle_perft(iss);
+    } else if (cmd == "divide") { // Debug
+        int depth = 1; iss >> depth;
+        perft_divide(pos, depth);
+    } else if (cmd == "perftsuite") { // perftsuite [threads N] [hash [MB]]
+        perft_suite(parse_perft_options(iss), perft_tt);
+    } else if (cmd == "smpbench") { // smpbench [depth D] [threads N]: Lazy SMP time-to-depth scaling
+        int depth = 8;
+        unsigned hw = std::thread::hardware_concurrency();
+        int threads = hw ? (int)hw : 1;
+        std::string tok;
         while (iss >> tok) {
-            Move m; // Create Move struct and validate move
-            if (!parse_uci_move(tok, m)) return;
-            if (!make_move(m)) return;
+            if (tok == "depth") iss >> depth;
+            else if (tok == "threads") iss >> threads;
+        }
+        smp_bench(depth, std::max(1, threads), (size_t)hash_mb);
+    } else if (cmd == "movecheck") { // Debug: movecheck [games] [seed] cross-checks single-move validation
+        int games = 20;
+        uint64_t seed = 1;
+        iss >> games >> seed;
+        uint64_t bad = verify_move_checks(games, seed);
+        std::cout << "movecheck " << (bad ? "MISMATCH " : "ok ") << bad << std::endl;
+    } else if (cmd == "fencheck") { // Debug: malformed FENs are turned away by set_fen/is_sane
+        uint64_t bad = verify_fen_checks();
+        std::cout << "fencheck " << (bad ? "MISMATCH " : "ok ") << bad << std::endl;
+    } else if (cmd == "attackbench") { // Debug: attackbench [rounds] times the attack lookups
+        int rounds = 20000; iss >> rounds;
+        attack_bench(std::max(1, rounds));
+    } else if (cmd == "key") { // Debug: key [depth] checks incremental hashing over a subtree
+        int depth = 0; iss >> depth;
+        uint64_t bad = verify_keys(pos, depth);
+        std::cout << "key " << std::hex << pos.key() << " recomputed " << pos.compute_key() << std::dec
+                  << (bad ? " MISMATCH " : " ok ") << bad << std::endl;
+    } else if (cmd == "legalcheck") { // Debug: legalcheck [depth] diffs both legal generators over a subtree
+        int depth = 1; iss >> depth;
+        uint64_t bad = verify_legal(pos, depth);
+        std::cout << "legalcheck " << (bad ? "MISMATCH " : "ok ") << bad << std::endl;
+    } else if (cmd == "nnuecheck") { // Debug: nnuecheck [depth] diffs incremental and refreshed accumulators
+        int depth = 3; iss >> depth;
+        if (!nnue_loaded()) {
+            std::cout << "nnuecheck needs an EvalFile" << std::endl;
+        } else {
+            uint64_t bad = verify_nnue(pos, depth);
+            std::cout << "nnuecheck " << (bad ? "MISMATCH " : "ok ") << bad << std::endl;
         }
+    } else if (cmd == "bookmake") { // Debug: bookmake <games.pgn> <out.bin> [maxply]
+        std::string in, out, error;
+        int maxPly = 16;
+        iss >> in >> out >> maxPly;
+        if (make_book(in, out, maxPly, error)) std::cout << "bookmake wrote " << out << std::endl;
+        else std::cout << "bookmake failed: " << error << std::endl;
+    } else if (cmd == "batch") { // batch <in> <out> [budget] [threads N] [csv|jsonl] [window N] [hash MB]
+        batch_command(iss);
+    } else if (cmd == "go") {
+        handle_go(iss);
     }
 }
 
+// Everything the reader thread doesn't answer itself, on the worker thread
+static void execute(const std::string& line) {
+    std::istringstream iss(line);
+    std::string cmd;
+    iss >> cmd;
+
+    if (cmd == "setoption") {
+        handle_setoption(line);
+    } else if (cmd == "ucinewgame") {
+        pos.set_startpos();
+        pos_base = "startpos";
+        pos_moves.clear();
+        TT.clear(search_threads);
+    } else if (cmd == "d") {
+        dump_board();
+    } else if (cmd == "position") {
+        handle_position(line);
+    } else if (cmd == "u") {
+        if (pos.undo_move() && !pos_moves.empty()) pos_moves.pop_back();
+    } else if (cmd == "eval") {
+        eval_trace(pos);
+    } else if (cmd == "moves") {
+        MoveList list;
+        pos.gen_legal_moves(list);
+        std::cerr << "moves: " << list.count << "\n";
+    } else if (cmd == "see") { // Debug: see <move> prints the static exchange result
+        std::string mv; iss >> mv;
+        Move m;
+        if (parse_uci_move(pos, mv, m) && pos.is_pseudo_legal(m)) std::cout << "see " << pos.see(m) << std::endl;
+        else std::cout << "see: not a move here: " << mv << std::endl;
+    } else if (cmd == "polykey") { // Debug: Polyglot key of the current position
+        std::cout << "polykey " << std::hex << polyglot_key(pos) << std::dec << std::endl;
+    } else if (cmd == "polycheck") { // Debug: keys of the published Polyglot test positions
+        int bad = verify_polyglot_keys();
+        std::cout << "polycheck " << (bad ? "MISMATCH " : "ok ") << bad << std::endl;
+    } else {
+        run_long_command(cmd, iss);
+    }
+}
+
+// Commands other than isready, stop, ponderhit, stats, uci and quit queue up here and the
+// worker runs them one at a time in arrival order. So a position or setoption sent during a
+// search waits its turn instead of blocking the reader, and the stop behind it still gets read.
+// Jobs are numbered as they arrive, which is how stop and ponderhit know whose they are.
+struct Job {
+    std::string line;
+    uint64_t seq = 0;
+    bool open_ended = false; // go infinite / go ponder: only a stop or ponderhit ends it
+};
+
+static std::mutex job_mutex;
+static std::condition_variable job_cv;
+static std::deque<Job> jobs;
+static uint64_t next_seq = 0;
+static uint64_t stop_before = 0;      // Jobs numbered below this have been told to stop
+static uint64_t ponderhit_before = 0; // ... and below this, that the ponder move was played
+static bool running_open_ended = false;
+static bool input_done = false; // End of input or quit: the worker exits once the queue is empty
+
+static void worker_loop() {
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(job_mutex);
+            job_cv.wait(lock, [] { return !jobs.empty() || input_done; });
+            if (jobs.empty()) return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+            running_open_ended = job.open_ended;
+            // A stop sent while this job was still queued is for it too. With the input gone
+            // nothing could end an open-ended search any more, so it stops straight away.
+            Signals.stop = job.seq < stop_before || (input_done && job.open_ended);
+            Signals.ponderhit = job.seq < ponderhit_before;
+        }
+        execute(job.line);
+        std::lock_guard<std::mutex> lock(job_mutex);
+        running_open_ended = false;
+    }
+}
+
+static void enqueue(const std::string& line) {
+    Job job;
+    job.line = line;
+    std::istringstream words(line);
+    std::string tok;
+    words >> tok;
+    if (tok == "go")
+        while (words >> tok)
+            if (tok == "infinite" || tok == "ponder") job.open_ended = true;
+
+    std::lock_guard<std::mutex> lock(job_mutex);
+    job.seq = next_seq++;
+    jobs.push_back(std::move(job));
+    job_cv.notify_one();
+}
+
+// This thread only reads and never waits on the worker: isready, stop, ponderhit and quit
+// are answered right away even in the middle of a search, a perft or a queue of commands
 void uci_loop() {
+    pos.set_startpos();
+    pos_base = "startpos";
+    TT.resize((size_t)hash_mb, search_threads);
+    std::thread worker(worker_loop);
+
     std::string line;
+    bool quit = false;
     while (std::getline(std::cin, line)) {
         std::istringstream iss(line);
         std::string cmd;
         iss >> cmd;
 
-        if (cmd == "uci") {
-            std::cout << "id name ChessBot\n";
-            std::cout << "uciok\n";
+        if (cmd.empty()) {
+            continue;
         } else if (cmd == "isready") {
-            std::cout << "readyok\n";
-        } else if (cmd == "ucinewgame") {
-            set_startpos();
-        } else if (cmd == "d") {
-            dump_board();
-        } else if (cmd == "position") {
-            handle_position(line);
-        } else if (cmd == "u") {
-            undo_move();
-        } else if (cmd == "moves") {
-            MoveList list;
-            gen_legal_moves(list);
-            std::cerr << "moves: " << list.count << "\n";
-        } else if (cmd == "perft") { // Debug
-            int depth; iss >> depth;
-            uint64_t nodes = perft(depth);
-            std::cout << "nodes " << nodes << std::endl;
-        } else if (cmd == "go") {
-            std::cout << "bestmove e2e4\n";
+            std::cout << "readyok\n" << std::flush;
+        } else if (cmd == "stop") {
+            std::lock_guard<std::mutex> lock(job_mutex);
+            stop_before = next_seq;
+            Signals.stop = true;
+        } else if (cmd == "ponderhit") {
+            std::lock_guard<std::mutex> lock(job_mutex);
+            ponderhit_before = next_seq;
+            Signals.ponderhit = true;
+        } else if (cmd == "stats") { // stats [reset]: counters since startup or the last reset, also mid-search
+            std::string sub; iss >> sub;
+            if (sub == "reset") stats_reset();
+            else std::cout << stats_report() << std::flush;
+        } else if (cmd == "uci") {
+            std::cout << "id name ChessBot\n"
+                         "option name Hash type spin default 16 min 1 max 65536\n"
+                         "option name Threads type spin default 1 min 1 max 1024\n"
+                         "option name Ponder type check default false\n"
+                         "option name EvalFile type string default <empty>\n"
+                         "option name BookFile type string default <empty>\n"
+                         "option name BookBestMove type check default false\n"
+                         "uciok\n" << std::flush;
         } else if (cmd == "quit") {
+            quit = true;
             break;
+        } else {
+            enqueue(line);
         }
     }
-}
\ No newline at end of file
+
+    // quit drops whatever is queued and cuts the running job short. At the end of the input
+    // scripted perfts and searches still finish, only open-ended searches are ended.
+    {
+        std::lock_guard<std::mutex> lock(job_mutex);
+        input_done = true;
+        if (quit) {
+            jobs.clear();
+            stop_before = next_seq;
+            Signals.stop = true;
+        } else if (running_open_ended) {
+            Signals.stop = true;
+        }
+    }
+    job_cv.notify_one();
+    worker.join();
+}